@@ -126,6 +126,14 @@ void Camera::SetLens(float fovY, float aspect, float zn, float zf)
 
 	XMMATRIX P = XMMatrixPerspectiveFovLH(mFovY, mAspect, mNearZ, mFarZ);
 	XMStoreFloat4x4(&mProj, P);
+
+	mFrustumDirty = true;
+	++mGeneration;
+}
+
+UINT Camera::GetGeneration()const
+{
+	return mGeneration;
 }
 
 void Camera::LookAt(FXMVECTOR pos, FXMVECTOR target, FXMVECTOR worldUp)
@@ -176,6 +184,27 @@ XMFLOAT4X4 Camera::GetProj4x4f()const
 	return mProj;
 }
 
+BoundingFrustum Camera::GetWorldFrustum()const
+{
+	assert(!mViewDirty);
+
+	if(mFrustumDirty)
+	{
+		// Build the frustum in view space from the projection, then carry it
+		// into world space with the inverse view transform.
+		BoundingFrustum viewFrustum;
+		BoundingFrustum::CreateFromMatrix(viewFrustum, XMLoadFloat4x4(&mProj));
+
+		XMMATRIX view = XMLoadFloat4x4(&mView);
+		XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+		viewFrustum.Transform(mWorldFrustum, invView);
+
+		mFrustumDirty = false;
+	}
+
+	return mWorldFrustum;
+}
+
 void Camera::Strafe(float d)
 {
 	// mPosition += d*mRight
@@ -294,6 +323,8 @@ void Camera::UpdateViewMatrix()
 		mView(3, 3) = 1.0f;
 
 		mViewDirty = false;
+		mFrustumDirty = true;
+		++mGeneration;
 	}
 }
 
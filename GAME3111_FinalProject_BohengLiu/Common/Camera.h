@@ -61,6 +61,15 @@ public:
 	DirectX::XMFLOAT4X4 GetView4x4f()const;
 	DirectX::XMFLOAT4X4 GetProj4x4f()const;
 
+	// Get the camera frustum in world space for culling and containment
+	// queries.  Rebuilt lazily, so it costs nothing while the camera is still.
+	DirectX::BoundingFrustum GetWorldFrustum()const;
+
+	// Change-generation counter: bumped whenever the view matrix is rebuilt
+	// or the lens changes, so callers can cache derived data (inverse
+	// matrices and the like) and skip recomputing it while the camera holds.
+	UINT GetGeneration()const;
+
 	// Strafe/Walk the camera a distance d.
 	void Strafe(float d);
 	void Walk(float d);
@@ -91,10 +100,16 @@ private:
 	float mFarWindowHeight = 0.0f;
 
 	bool mViewDirty = true;
+	UINT mGeneration = 0;
 
 	// Cache View/Proj matrices.
 	DirectX::XMFLOAT4X4 mView = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 mProj = MathHelper::Identity4x4();
+
+	// Cache world-space frustum.  Dirtied whenever the view matrix is rebuilt
+	// or the lens changes; mutable so the const getter can refresh it.
+	mutable DirectX::BoundingFrustum mWorldFrustum;
+	mutable bool mFrustumDirty = true;
 };
 
 #endif // CAMERA_H
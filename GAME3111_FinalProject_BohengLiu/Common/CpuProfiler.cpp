@@ -0,0 +1,172 @@
+//***************************************************************************************
+// CpuProfiler.cpp
+//***************************************************************************************
+
+#include "CpuProfiler.h"
+
+#include <cfloat>
+#include <fstream>
+#include <sstream>
+
+CpuProfiler::CpuProfiler()
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    mMsPerTick = 1000.0 / (double)frequency.QuadPart;
+}
+
+CpuProfiler& CpuProfiler::Instance()
+{
+    static CpuProfiler instance;
+    return instance;
+}
+
+CpuProfiler::ThreadBuffer& CpuProfiler::LocalBuffer()
+{
+    // Each thread resolves its buffer once; only the registration of a new
+    // thread takes the list lock.
+    thread_local ThreadBuffer* buffer = nullptr;
+    if(buffer == nullptr)
+    {
+        auto owned = std::make_unique<ThreadBuffer>();
+        buffer = owned.get();
+
+        std::lock_guard<std::mutex> lock(mBufferListMutex);
+        mBuffers.push_back(std::move(owned));
+    }
+
+    return *buffer;
+}
+
+void CpuProfiler::BeginScope(const char* name)
+{
+    ThreadBuffer& buffer = LocalBuffer();
+
+    std::string path = buffer.PathStack.empty() ?
+        std::string(name) : buffer.PathStack.back() + "/" + name;
+    buffer.PathStack.push_back(std::move(path));
+
+    // Timestamp last so path construction is not charged to the scope.
+    LARGE_INTEGER start;
+    QueryPerformanceCounter(&start);
+    buffer.StartStack.push_back(start.QuadPart);
+}
+
+void CpuProfiler::EndScope()
+{
+    LARGE_INTEGER end;
+    QueryPerformanceCounter(&end);
+
+    ThreadBuffer& buffer = LocalBuffer();
+
+    Record record;
+    record.Path = std::move(buffer.PathStack.back());
+    record.Depth = (int)buffer.PathStack.size() - 1;
+    record.Ms = (double)(end.QuadPart - buffer.StartStack.back()) * mMsPerTick;
+
+    buffer.PathStack.pop_back();
+    buffer.StartStack.pop_back();
+
+    std::lock_guard<std::mutex> lock(buffer.Mutex);
+    buffer.Completed.push_back(std::move(record));
+}
+
+void CpuProfiler::EndFrame()
+{
+    // A scope can run more than once per frame (e.g. DrawRenderItems per
+    // layer), so per-path times are summed for the frame before being folded
+    // into the rolling statistics.
+    std::map<std::string, std::pair<int, double>> frameTotals;
+
+    {
+        std::lock_guard<std::mutex> listLock(mBufferListMutex);
+        for(auto& buffer : mBuffers)
+        {
+            std::lock_guard<std::mutex> lock(buffer->Mutex);
+            for(auto& record : buffer->Completed)
+            {
+                auto& total = frameTotals[record.Path];
+                total.first = record.Depth;
+                total.second += record.Ms;
+            }
+            buffer->Completed.clear();
+        }
+    }
+
+    mLastFrame.clear();
+    for(auto& entry : frameTotals)
+        mLastFrame.push_back({entry.first, entry.second.first, entry.second.second});
+
+    for(auto& entry : frameTotals)
+    {
+        ScopeStats& stats = mStats[entry.first];
+        double frameMs = entry.second.second;
+
+        stats.Depth = entry.second.first;
+        stats.TotalMs += frameMs;
+        stats.MinMs = stats.Frames == 0 ? frameMs : (frameMs < stats.MinMs ? frameMs : stats.MinMs);
+        stats.MaxMs = frameMs > stats.MaxMs ? frameMs : stats.MaxMs;
+        stats.Frames++;
+    }
+}
+
+std::string CpuProfiler::BuildReport() const
+{
+    std::ostringstream report;
+    report.setf(std::ios::fixed);
+    report.precision(3);
+
+    for(auto& entry : mStats)
+    {
+        const ScopeStats& stats = entry.second;
+        if(stats.Frames == 0)
+            continue;
+
+        // Indent by depth and print the last path component only; the
+        // sorted map already places children under their parent.
+        size_t lastSlash = entry.first.find_last_of('/');
+        std::string name = lastSlash == std::string::npos ?
+            entry.first : entry.first.substr(lastSlash + 1);
+
+        report << std::string(2*stats.Depth, ' ') << name
+               << "  min " << stats.MinMs
+               << "  avg " << stats.TotalMs / (double)stats.Frames
+               << "  max " << stats.MaxMs << " ms\n";
+    }
+
+    return report.str();
+}
+
+void CpuProfiler::DumpCsv(const std::string& filename) const
+{
+    std::ifstream probe(filename);
+    bool writeHeader = !probe.good();
+    probe.close();
+
+    std::ofstream file(filename, std::ios::app);
+    if(!file)
+        return;
+
+    if(writeHeader)
+        file << "path,frames,min_ms,avg_ms,max_ms\n";
+
+    file.setf(std::ios::fixed);
+    file.precision(4);
+
+    for(auto& entry : mStats)
+    {
+        const ScopeStats& stats = entry.second;
+        if(stats.Frames == 0)
+            continue;
+
+        file << entry.first << "," << stats.Frames
+             << "," << stats.MinMs
+             << "," << stats.TotalMs / (double)stats.Frames
+             << "," << stats.MaxMs << "\n";
+    }
+}
+
+void CpuProfiler::Reset()
+{
+    mStats.clear();
+}
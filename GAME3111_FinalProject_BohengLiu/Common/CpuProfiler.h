@@ -0,0 +1,115 @@
+//***************************************************************************************
+// CpuProfiler.h
+//
+// Scoped hierarchical CPU timing built on QueryPerformanceCounter.  Wrap a
+// region in PROFILE_SCOPE("Name") and the profiler records its inclusive time
+// under the full path of enclosing scopes (e.g. "Draw/DrawRenderItems").
+// Scopes may begin and end on any thread; each thread appends to its own
+// buffer, so instrumentation adds no locking to the timed code.  Once per
+// frame the app calls EndFrame() to fold the buffers into rolling
+// min/avg/max statistics, which can be reported as text or dumped to CSV.
+//***************************************************************************************
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <windows.h>
+
+class CpuProfiler
+{
+public:
+
+    CpuProfiler(const CpuProfiler& rhs) = delete;
+    CpuProfiler& operator=(const CpuProfiler& rhs) = delete;
+
+    static CpuProfiler& Instance();
+
+    // Usually entered through PROFILE_SCOPE rather than called directly.
+    void BeginScope(const char* name);
+    void EndScope();
+
+    // One scope path's inclusive time for a single frame.
+    struct FrameTotal
+    {
+        std::string Path;
+        int Depth = 0;
+        double Ms = 0.0;
+    };
+
+    // Closes the current frame: drains every thread's completed scopes and
+    // folds the per-frame totals into the rolling statistics.  Call once per
+    // frame, after Draw, from the thread that owns the frame loop.
+    void EndFrame();
+
+    // The per-path totals of the frame EndFrame last closed, in report
+    // order.  Valid until the next EndFrame; the flight recorder snapshots
+    // these into its ring.
+    const std::vector<FrameTotal>& LastFrameTotals() const { return mLastFrame; }
+
+    // Hierarchical report of the rolling statistics, one indented line per
+    // scope path, suitable for OutputDebugString.
+    std::string BuildReport() const;
+
+    // Appends one CSV row per scope path (path, frames, min, avg, max in ms)
+    // to the given file, writing a header if the file is new.
+    void DumpCsv(const std::string& filename) const;
+
+    // Restarts the rolling min/avg/max window.
+    void Reset();
+
+private:
+
+    CpuProfiler();
+
+    struct Record
+    {
+        std::string Path;
+        int Depth = 0;
+        double Ms = 0.0;
+    };
+
+    // One per thread that ever opens a scope.  Owned by the profiler and
+    // kept alive for the run, so draining after a worker finished is safe.
+    struct ThreadBuffer
+    {
+        std::vector<std::string> PathStack;
+        std::vector<LONGLONG> StartStack;
+        std::vector<Record> Completed;
+        std::mutex Mutex;
+    };
+
+    struct ScopeStats
+    {
+        int Depth = 0;
+        UINT64 Frames = 0;
+        double TotalMs = 0.0;
+        double MinMs = 0.0;
+        double MaxMs = 0.0;
+    };
+
+    ThreadBuffer& LocalBuffer();
+
+    double mMsPerTick = 0.0;
+
+    std::mutex mBufferListMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> mBuffers;
+
+    // Keyed by full scope path; std::map keeps parents sorted directly
+    // before their children, which is the report order we want.
+    std::map<std::string, ScopeStats> mStats;
+
+    std::vector<FrameTotal> mLastFrame;
+};
+
+// Times the remainder of the enclosing block under the given name.
+#define PROFILE_SCOPE(name) CpuProfileScope __cpuProfileScope##__LINE__(name)
+
+struct CpuProfileScope
+{
+    CpuProfileScope(const char* name) { CpuProfiler::Instance().BeginScope(name); }
+    ~CpuProfileScope() { CpuProfiler::Instance().EndScope(); }
+};
@@ -21,9 +21,21 @@
 #include <assert.h>
 #include <algorithm>
 #include <memory>
+#include <vector>
 #include <wrl.h>
 
-#include "DDSTextureLoader.h" 
+#include "DDSTextureLoader.h"
+#include "GpuMemoryTracker.h"
+#include "TextureHeap.h"
+
+// Shared placement heap for the DX12 texture path; when installed, textures
+// place into it instead of each owning a committed heap.
+static TextureHeap* g_texturePlacementHeap = nullptr;
+
+void DirectX::SetDDSTexturePlacementHeap(TextureHeap* heap)
+{
+	g_texturePlacementHeap = heap;
+} 
 
 using namespace Microsoft::WRL;
 
@@ -269,6 +281,146 @@ static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
 }
 
 
+//--------------------------------------------------------------------------------------
+// Memory-mapped variant of LoadTextureDataFromFile.  The header is parsed and the
+// texel data is sourced straight from the OS file mapping, so the file contents are
+// never duplicated into a heap buffer.  The mapping must stay alive until the
+// UpdateSubresources copy has consumed the bit data.
+//--------------------------------------------------------------------------------------
+struct MappedTextureFile
+{
+    ScopedHandle file;
+    ScopedHandle mapping;
+    void*        view = nullptr;
+
+    ~MappedTextureFile()
+    {
+        if (view)
+            UnmapViewOfFile( view );
+    }
+};
+
+static HRESULT MapTextureDataFromFile( _In_z_ const wchar_t* fileName,
+                                       MappedTextureFile& mapped,
+                                       DDS_HEADER** header,
+                                       uint8_t** bitData,
+                                       size_t* bitSize
+                                     )
+{
+    if (!header || !bitData || !bitSize)
+    {
+        return E_POINTER;
+    }
+
+    // open the file
+#if (_WIN32_WINNT >= _WIN32_WINNT_WIN8)
+    mapped.file.reset( safe_handle( CreateFile2( fileName,
+                                                 GENERIC_READ,
+                                                 FILE_SHARE_READ,
+                                                 OPEN_EXISTING,
+                                                 nullptr ) ) );
+#else
+    mapped.file.reset( safe_handle( CreateFileW( fileName,
+                                                 GENERIC_READ,
+                                                 FILE_SHARE_READ,
+                                                 nullptr,
+                                                 OPEN_EXISTING,
+                                                 FILE_ATTRIBUTE_NORMAL,
+                                                 nullptr ) ) );
+#endif
+
+    if ( !mapped.file )
+    {
+        return HRESULT_FROM_WIN32( GetLastError() );
+    }
+
+    // Get the file size
+    LARGE_INTEGER FileSize = { 0 };
+
+#if (_WIN32_WINNT >= _WIN32_WINNT_VISTA)
+    FILE_STANDARD_INFO fileInfo;
+    if ( !GetFileInformationByHandleEx( mapped.file.get(), FileStandardInfo, &fileInfo, sizeof(fileInfo) ) )
+    {
+        return HRESULT_FROM_WIN32( GetLastError() );
+    }
+    FileSize = fileInfo.EndOfFile;
+#else
+    GetFileSizeEx( mapped.file.get(), &FileSize );
+#endif
+
+    // File is too big for 32-bit addressing, so reject
+    if (FileSize.HighPart > 0)
+    {
+        return E_FAIL;
+    }
+
+    // Need at least enough data to fill the header and magic number to be a valid DDS
+    if (FileSize.LowPart < ( sizeof(DDS_HEADER) + sizeof(uint32_t) ) )
+    {
+        return E_FAIL;
+    }
+
+    // map the whole file read-only instead of copying it into a heap buffer
+    mapped.mapping.reset( safe_handle( CreateFileMappingW( mapped.file.get(),
+                                                           nullptr,
+                                                           PAGE_READONLY,
+                                                           0,
+                                                           0,
+                                                           nullptr ) ) );
+    if ( !mapped.mapping )
+    {
+        return HRESULT_FROM_WIN32( GetLastError() );
+    }
+
+    mapped.view = MapViewOfFile( mapped.mapping.get(), FILE_MAP_READ, 0, 0, 0 );
+    if ( !mapped.view )
+    {
+        return HRESULT_FROM_WIN32( GetLastError() );
+    }
+
+    auto fileData = reinterpret_cast<uint8_t*>( mapped.view );
+
+    // DDS files always start with the same magic number ("DDS ")
+    uint32_t dwMagicNumber = *( const uint32_t* )( fileData );
+    if (dwMagicNumber != DDS_MAGIC)
+    {
+        return E_FAIL;
+    }
+
+    auto hdr = reinterpret_cast<DDS_HEADER*>( fileData + sizeof( uint32_t ) );
+
+    // Verify header to validate DDS file
+    if (hdr->size != sizeof(DDS_HEADER) ||
+        hdr->ddspf.size != sizeof(DDS_PIXELFORMAT))
+    {
+        return E_FAIL;
+    }
+
+    // Check for DX10 extension
+    bool bDXT10Header = false;
+    if ((hdr->ddspf.flags & DDS_FOURCC) &&
+        (MAKEFOURCC( 'D', 'X', '1', '0' ) == hdr->ddspf.fourCC))
+    {
+        // Must be long enough for both headers and magic value
+        if (FileSize.LowPart < ( sizeof(DDS_HEADER) + sizeof(uint32_t) + sizeof(DDS_HEADER_DXT10) ) )
+        {
+            return E_FAIL;
+        }
+
+        bDXT10Header = true;
+    }
+
+    // setup the pointers in the process request
+    *header = hdr;
+    ptrdiff_t offset = sizeof( uint32_t ) + sizeof( DDS_HEADER )
+                       + (bDXT10Header ? sizeof( DDS_HEADER_DXT10 ) : 0);
+    *bitData = fileData + offset;
+    *bitSize = FileSize.LowPart - offset;
+
+    return S_OK;
+}
+
+
 //--------------------------------------------------------------------------------------
 // Return the BPP for a particular format
 //--------------------------------------------------------------------------------------
@@ -1269,14 +1421,24 @@ static HRESULT CreateD3DResources12(
 		texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
 		texDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
 
-		hr = device->CreateCommittedResource(
-			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-			D3D12_HEAP_FLAG_NONE,
-			&texDesc,
-			D3D12_RESOURCE_STATE_COMMON,
-			nullptr,
-			IID_PPV_ARGS(&texture)
-			);
+		// Prefer a placed allocation in the shared texture heap when one is
+		// installed; a committed resource (with its per-texture implicit
+		// heap) is the fallback when the heap is absent or full.
+		hr = S_OK;
+		if (g_texturePlacementHeap != nullptr)
+			texture = g_texturePlacementHeap->CreatePlaced(texDesc, D3D12_RESOURCE_STATE_COMMON);
+
+		if (texture == nullptr)
+		{
+			hr = device->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+				D3D12_HEAP_FLAG_NONE,
+				&texDesc,
+				D3D12_RESOURCE_STATE_COMMON,
+				nullptr,
+				IID_PPV_ARGS(&texture)
+				);
+		}
 
 		if (FAILED(hr))
 		{
@@ -1285,6 +1447,8 @@ static HRESULT CreateD3DResources12(
 		}
 		else
 		{
+			GpuMemoryTracker::Instance().Track(texture.Get(), GpuMemoryTracker::Category::Textures);
+
 			const UINT num2DSubresources = texDesc.DepthOrArraySize * texDesc.MipLevels;
 			const UINT64 uploadBufferSize = GetRequiredIntermediateSize(texture.Get(), 0, num2DSubresources);
 
@@ -1901,6 +2065,267 @@ static DDS_ALPHA_MODE GetAlphaMode( _In_ const DDS_HEADER* header )
     return DDS_ALPHA_MODE_UNKNOWN;
 }
 
+//--------------------------------------------------------------------------------------
+// Runtime BC1 fallback for uncompressed textures.  Artist-supplied RGBA8 DDS
+// files quadruple VRAM and sampling bandwidth versus block compression, so
+// qualifying 2D textures are compressed once at load, the result is written
+// next to the source as <name>.dds.bc1.dds, and later runs load the cache
+// directly through the normal path.
+//--------------------------------------------------------------------------------------
+static bool IsBC1CompressCandidate( _In_ DXGI_FORMAT format )
+{
+    switch (format)
+    {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8X8_UNORM:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// The cache is current when it exists and is no older than its source, so
+// re-exported art recompresses on the next launch.
+static bool IsBC1CacheCurrent( _In_z_ const wchar_t* cachePath, _In_z_ const wchar_t* sourcePath )
+{
+    WIN32_FILE_ATTRIBUTE_DATA cacheAttr, sourceAttr;
+    if ( !GetFileAttributesExW( cachePath, GetFileExInfoStandard, &cacheAttr ) )
+        return false;
+    if ( !GetFileAttributesExW( sourcePath, GetFileExInfoStandard, &sourceAttr ) )
+        return false;
+
+    return CompareFileTime( &cacheAttr.ftLastWriteTime, &sourceAttr.ftLastWriteTime ) >= 0;
+}
+
+static uint16_t PackColor565( _In_reads_(3) const uint8_t* rgb )
+{
+    return static_cast<uint16_t>( ((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3) );
+}
+
+static void UnpackColor565( _In_ uint16_t c, _Out_writes_(3) int* rgb )
+{
+    rgb[0] = (( c >> 11)       ) * 255 / 31;
+    rgb[1] = (( c >>  5) & 0x3f) * 255 / 63;
+    rgb[2] = (  c        & 0x1f) * 255 / 31;
+}
+
+// Range-fit: the endpoints span the block's RGB bounding box and every texel
+// snaps to the nearest of the four palette entries.  Fast enough to run at
+// load and close to an exhaustive fit on the photographic content here.
+static void CompressBlockBC1( _In_reads_(16 * 4) const uint8_t* texels, _Out_writes_(8) uint8_t* out )
+{
+    uint8_t minColor[3] = { 255, 255, 255 };
+    uint8_t maxColor[3] = { 0, 0, 0 };
+    for (size_t i = 0; i < 16; ++i)
+    {
+        for (size_t c = 0; c < 3; ++c)
+        {
+            uint8_t v = texels[i * 4 + c];
+            if (v < minColor[c]) minColor[c] = v;
+            if (v > maxColor[c]) maxColor[c] = v;
+        }
+    }
+
+    uint16_t c0 = PackColor565( maxColor );
+    uint16_t c1 = PackColor565( minColor );
+
+    // c0 > c1 selects the opaque four-color mode; equal endpoints make the
+    // palette order irrelevant and every index can stay zero.
+    if (c0 < c1)
+    {
+        uint16_t t = c0; c0 = c1; c1 = t;
+    }
+
+    out[0] = static_cast<uint8_t>( c0 & 0xff );
+    out[1] = static_cast<uint8_t>( c0 >> 8 );
+    out[2] = static_cast<uint8_t>( c1 & 0xff );
+    out[3] = static_cast<uint8_t>( c1 >> 8 );
+
+    if (c0 == c1)
+    {
+        out[4] = out[5] = out[6] = out[7] = 0;
+        return;
+    }
+
+    // Build the palette from the quantized endpoints so the index selection
+    // measures the same colors the decoder reconstructs.
+    int palette[4][3];
+    UnpackColor565( c0, palette[0] );
+    UnpackColor565( c1, palette[1] );
+    for (size_t c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    for (size_t y = 0; y < 4; ++y)
+    {
+        uint8_t rowBits = 0;
+        for (size_t x = 0; x < 4; ++x)
+        {
+            const uint8_t* texel = texels + (y * 4 + x) * 4;
+
+            size_t best = 0;
+            int bestDist = 3 * 255 * 255 + 1;
+            for (size_t p = 0; p < 4; ++p)
+            {
+                int dr = palette[p][0] - texel[0];
+                int dg = palette[p][1] - texel[1];
+                int db = palette[p][2] - texel[2];
+                int dist = dr * dr + dg * dg + db * db;
+                if (dist < bestDist)
+                {
+                    bestDist = dist;
+                    best = p;
+                }
+            }
+
+            rowBits |= static_cast<uint8_t>( best << (x * 2) );
+        }
+        out[4 + y] = rowBits;
+    }
+}
+
+// Compresses every mip of an uncompressed opaque 2D DDS to BC1 and writes a
+// DX10-header DDS to cachePath; returns false when the texture does not
+// qualify (volume/cubemap, or the alpha channel is in use -- BC1's single
+// transparency bit cannot carry it) and the caller falls through untouched.
+static bool WriteBC1CompressedCache( _In_z_ const wchar_t* cachePath,
+    _In_ const DDS_HEADER* header,
+    _In_reads_bytes_(bitSize) const uint8_t* bitData,
+    _In_ size_t bitSize )
+{
+    DXGI_FORMAT format = GetDXGIFormat( header->ddspf );
+    if ( !IsBC1CompressCandidate( format ) )
+        return false;
+    if ( header->flags & DDS_HEADER_FLAGS_VOLUME )
+        return false;
+    if ( header->caps2 & DDS_CUBEMAP )
+        return false;
+
+    const size_t width = header->width;
+    const size_t height = header->height;
+    const size_t mipCount = (header->mipMapCount != 0) ? header->mipMapCount : 1;
+    if ( width == 0 || height == 0 )
+        return false;
+
+    const bool bgr = ( format == DXGI_FORMAT_B8G8R8A8_UNORM ||
+                       format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB ||
+                       format == DXGI_FORMAT_B8G8R8X8_UNORM );
+    const bool hasAlpha = ( format != DXGI_FORMAT_B8G8R8X8_UNORM );
+    const bool srgb = ( MakeSRGB( format ) == format );
+
+    // First pass validates the surface sizes and rejects textures that use
+    // their alpha channel.
+    {
+        size_t offset = 0;
+        size_t w = width, h = height;
+        for (size_t mip = 0; mip < mipCount; ++mip)
+        {
+            size_t surfaceBytes = w * h * 4;
+            if ( offset + surfaceBytes > bitSize )
+                return false;
+
+            if ( hasAlpha )
+            {
+                const uint8_t* surface = bitData + offset;
+                for (size_t i = 3; i < surfaceBytes; i += 4)
+                {
+                    if ( surface[i] != 255 )
+                        return false;
+                }
+            }
+
+            offset += surfaceBytes;
+            w = (w > 1) ? w / 2 : 1;
+            h = (h > 1) ? h / 2 : 1;
+        }
+    }
+
+    std::vector<uint8_t> blocks;
+    {
+        size_t offset = 0;
+        size_t w = width, h = height;
+        for (size_t mip = 0; mip < mipCount; ++mip)
+        {
+            const uint8_t* surface = bitData + offset;
+            size_t rowPitch = w * 4;
+            size_t blocksWide = (w + 3) / 4;
+            size_t blocksHigh = (h + 3) / 4;
+
+            for (size_t by = 0; by < blocksHigh; ++by)
+            {
+                for (size_t bx = 0; bx < blocksWide; ++bx)
+                {
+                    // Gather the 4x4 block in RGBA order, clamping at the
+                    // edges for the small mips.
+                    uint8_t texels[16 * 4];
+                    for (size_t y = 0; y < 4; ++y)
+                    {
+                        size_t sy = by * 4 + y;
+                        if ( sy >= h ) sy = h - 1;
+                        const uint8_t* row = surface + sy * rowPitch;
+                        for (size_t x = 0; x < 4; ++x)
+                        {
+                            size_t sx = bx * 4 + x;
+                            if ( sx >= w ) sx = w - 1;
+                            const uint8_t* src = row + sx * 4;
+                            uint8_t* dst = texels + (y * 4 + x) * 4;
+                            dst[0] = bgr ? src[2] : src[0];
+                            dst[1] = src[1];
+                            dst[2] = bgr ? src[0] : src[2];
+                            dst[3] = src[3];
+                        }
+                    }
+
+                    uint8_t compressed[8];
+                    CompressBlockBC1( texels, compressed );
+                    blocks.insert( blocks.end(), compressed, compressed + 8 );
+                }
+            }
+
+            offset += w * h * 4;
+            w = (w > 1) ? w / 2 : 1;
+            h = (h > 1) ? h / 2 : 1;
+        }
+    }
+
+    // Write the cache as a DX10-header DDS so the sRGB distinction survives
+    // the legacy pixel-format round trip.
+    DDS_HEADER outHeader = *header;
+    outHeader.size = sizeof(DDS_HEADER);
+    outHeader.pitchOrLinearSize = static_cast<uint32_t>( ((width + 3) / 4) * ((height + 3) / 4) * 8 );
+    outHeader.ddspf.size = sizeof(DDS_PIXELFORMAT);
+    outHeader.ddspf.flags = DDS_FOURCC;
+    outHeader.ddspf.fourCC = MAKEFOURCC( 'D', 'X', '1', '0' );
+    outHeader.ddspf.RGBBitCount = 0;
+    outHeader.ddspf.RBitMask = 0;
+    outHeader.ddspf.GBitMask = 0;
+    outHeader.ddspf.BBitMask = 0;
+    outHeader.ddspf.ABitMask = 0;
+
+    DDS_HEADER_DXT10 outExt = {};
+    outExt.dxgiFormat = srgb ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM;
+    outExt.resourceDimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    outExt.arraySize = 1;
+
+    ScopedHandle cacheFile( safe_handle( CreateFileW( cachePath, GENERIC_WRITE, 0,
+        nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr ) ) );
+    if ( !cacheFile )
+        return false;
+
+    DWORD bytesWritten = 0;
+    BOOL ok = WriteFile( cacheFile.get(), &DDS_MAGIC, sizeof(DDS_MAGIC), &bytesWritten, nullptr );
+    ok = ok && WriteFile( cacheFile.get(), &outHeader, sizeof(outHeader), &bytesWritten, nullptr );
+    ok = ok && WriteFile( cacheFile.get(), &outExt, sizeof(outExt), &bytesWritten, nullptr );
+    ok = ok && WriteFile( cacheFile.get(), blocks.data(), static_cast<DWORD>( blocks.size() ), &bytesWritten, nullptr );
+
+    return ok != FALSE;
+}
+
 
 //--------------------------------------------------------------------------------------
 _Use_decl_annotations_
@@ -2164,13 +2589,35 @@ HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 	uint8_t* bitData = nullptr;
 	size_t bitSize = 0;
 
-	std::unique_ptr<uint8_t[]> ddsData;
-	HRESULT hr = LoadTextureDataFromFile(szFileName, ddsData, &header, &bitData, &bitSize);
+	// Parse the header and source the UpdateSubresources copy straight from a
+	// read-only file mapping; the view stays mapped until this call returns,
+	// by which point the texel data has been copied into the upload heap.
+	MappedTextureFile mapped;
+	HRESULT hr = MapTextureDataFromFile(szFileName, mapped, &header, &bitData, &bitSize);
 	if (FAILED(hr))
 	{
 		return hr;
 	}
 
+	// Uncompressed 2D content takes the block-compression detour: compress
+	// once, cache next to the source, and reload through this same path (the
+	// cache is BC1 so it cannot recurse).  Textures that fail to qualify --
+	// alpha in use, cubemap/volume -- fall through to the plain upload.
+	if (IsBC1CompressCandidate(GetDXGIFormat(header->ddspf)))
+	{
+		wchar_t cachePath[MAX_PATH];
+		swprintf_s(cachePath, L"%s.bc1.dds", szFileName);
+
+		if (!IsBC1CacheCurrent(cachePath, szFileName))
+			WriteBC1CompressedCache(cachePath, header, bitData, bitSize);
+
+		if (IsBC1CacheCurrent(cachePath, szFileName))
+		{
+			return CreateDDSTextureFromFile12(device, cmdList, cachePath,
+				texture, textureUploadHeap, maxsize, alphaMode);
+		}
+	}
+
 	hr = CreateTextureFromDDS12(device, cmdList, header,
 		bitData, bitSize, maxsize, false, texture, textureUploadHeap);
 
@@ -2228,6 +2675,115 @@ HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 	return hr;
 }
 
+HRESULT DirectX::CreateDDSTextureArrayFromFiles12(_In_ ID3D12Device* device,
+	_In_ ID3D12GraphicsCommandList* cmdList,
+	_In_reads_(fileCount) const std::wstring* fileNames,
+	_In_ size_t fileCount,
+	_Out_ ComPtr<ID3D12Resource>& texture,
+	_Out_ ComPtr<ID3D12Resource>& textureUploadHeap)
+{
+	texture = nullptr;
+	textureUploadHeap = nullptr;
+
+	if (!device || !fileNames || fileCount == 0)
+	{
+		return E_INVALIDARG;
+	}
+
+	// Every file stays mapped until the single UpdateSubresources copy below
+	// has consumed all the slices.
+	std::vector<MappedTextureFile> mapped(fileCount);
+	std::vector<D3D12_SUBRESOURCE_DATA> initData;
+
+	UINT width = 0;
+	UINT height = 0;
+	size_t mipCount = 0;
+	DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+
+	for (size_t i = 0; i < fileCount; ++i)
+	{
+		DDS_HEADER* header = nullptr;
+		uint8_t* bitData = nullptr;
+		size_t bitSize = 0;
+
+		HRESULT hr = MapTextureDataFromFile(fileNames[i].c_str(), mapped[i], &header, &bitData, &bitSize);
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+
+		// Only plain 2D textures can be packed; files that are already
+		// arrays, cubes, or volumes keep their own resource.
+		if ((header->ddspf.flags & DDS_FOURCC) && (MAKEFOURCC('D', 'X', '1', '0') == header->ddspf.fourCC))
+		{
+			return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+		}
+		if ((header->flags & DDS_HEADER_FLAGS_VOLUME) || (header->caps2 & DDS_CUBEMAP))
+		{
+			return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+		}
+
+		DXGI_FORMAT fileFormat = GetDXGIFormat(header->ddspf);
+		if (fileFormat == DXGI_FORMAT_UNKNOWN)
+		{
+			return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+		}
+
+		size_t fileMips = header->mipMapCount;
+		if (0 == fileMips) fileMips = 1;
+
+		if (i == 0)
+		{
+			width = header->width;
+			height = header->height;
+			mipCount = fileMips;
+			format = fileFormat;
+
+			if (mipCount > D3D12_REQ_MIP_LEVELS ||
+				fileCount > D3D12_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION ||
+				width > D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION ||
+				height > D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION)
+			{
+				return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+			}
+
+			initData.resize(mipCount * fileCount);
+		}
+		else if (header->width != width || header->height != height ||
+			fileMips != mipCount || fileFormat != format)
+		{
+			// Array slices must be identical in layout.
+			return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+		}
+
+		size_t twidth = 0;
+		size_t theight = 0;
+		size_t tdepth = 0;
+		size_t skipMip = 0;
+
+		hr = FillInitData12(
+			width, height, 1, mipCount, 1, format, 0, bitSize, bitData,
+			twidth, theight, tdepth, skipMip, &initData[i * mipCount]);
+		if (FAILED(hr))
+		{
+			return hr;
+		}
+	}
+
+	return CreateD3DResources12(
+		device, cmdList,
+		D3D12_RESOURCE_DIMENSION_TEXTURE2D,
+		width, height, 1,
+		mipCount,
+		fileCount,
+		format,
+		false, // forceSRGB
+		false, // isCubeMap
+		initData.data(),
+		texture,
+		textureUploadHeap);
+}
+
 _Use_decl_annotations_
 HRESULT DirectX::CreateDDSTextureFromFile( ID3D11Device* d3dDevice,
                                            ID3D11DeviceContext* d3dContext,
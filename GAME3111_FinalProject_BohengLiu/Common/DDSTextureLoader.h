@@ -29,6 +29,7 @@
 #pragma warning(push)
 #pragma warning(disable : 4005)
 #include <stdint.h>
+#include <string>
 
 #pragma warning(pop)
 
@@ -44,6 +45,8 @@
 #define _Use_decl_annotations_
 #endif
 
+class TextureHeap;
+
 namespace DirectX
 {
     enum DDS_ALPHA_MODE
@@ -83,6 +86,12 @@ namespace DirectX
                                       _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
                                     );
 
+	// Routes subsequent DDS texture creation through placed allocations in
+	// the given shared heap; textures the heap cannot fit (or all of them,
+	// when no heap is installed) fall back to committed resources.  Pass
+	// null to restore committed-only behavior.
+	void SetDDSTexturePlacementHeap(_In_opt_ TextureHeap* heap);
+
 	HRESULT CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 		                               _In_ ID3D12GraphicsCommandList* cmdList,
 		                               _In_z_ const wchar_t* szFileName,
@@ -92,6 +101,17 @@ namespace DirectX
 		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
 		                               );
 
+	// Packs several same-format, same-size 2D DDS files into one
+	// Texture2DArray with one slice per file, in the order given.  Fails if
+	// any file's width, height, mip count, or format differs from the first.
+	HRESULT CreateDDSTextureArrayFromFiles12(_In_ ID3D12Device* device,
+		                                     _In_ ID3D12GraphicsCommandList* cmdList,
+		                                     _In_reads_(fileCount) const std::wstring* fileNames,
+		                                     _In_ size_t fileCount,
+		                                     _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& texture,
+		                                     _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& textureUploadHeap
+		                                     );
+
     // Standard version with optional auto-gen mipmap support
     HRESULT CreateDDSTextureFromMemory( _In_ ID3D11Device* d3dDevice,
                                         _In_opt_ ID3D11DeviceContext* d3dContext,
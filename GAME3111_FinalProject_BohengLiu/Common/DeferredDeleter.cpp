@@ -0,0 +1,58 @@
+//***************************************************************************************
+// DeferredDeleter.cpp
+//***************************************************************************************
+
+#include "DeferredDeleter.h"
+
+#include <d3d12.h>
+
+#include "GpuMemoryTracker.h"
+
+using Microsoft::WRL::ComPtr;
+
+DeferredDeleter& DeferredDeleter::Instance()
+{
+    static DeferredDeleter instance;
+    return instance;
+}
+
+void DeferredDeleter::Defer(ComPtr<IUnknown> resource, UINT64 fenceValue)
+{
+    if (resource == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries.push_back({std::move(resource), fenceValue});
+}
+
+void DeferredDeleter::Collect(UINT64 completedFence)
+{
+    // Move the ripe entries out under the lock; the actual releases (and
+    // whatever driver work they trigger) run outside it.
+    std::vector<Entry> ripe;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (size_t i = 0; i < mEntries.size();)
+        {
+            if (mEntries[i].FenceValue <= completedFence)
+            {
+                ripe.push_back(std::move(mEntries[i]));
+                mEntries[i] = std::move(mEntries.back());
+                mEntries.pop_back();
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+
+    for (auto& entry : ripe)
+    {
+        // Keep the memory tracker's books straight for the resources it
+        // knows; Untrack ignores the rest.
+        ComPtr<ID3D12Resource> resource;
+        if (SUCCEEDED(entry.Resource.As(&resource)))
+            GpuMemoryTracker::Instance().Untrack(resource.Get());
+    }
+}
@@ -0,0 +1,59 @@
+//***************************************************************************************
+// DeferredDeleter.h
+//
+// Fence-keyed deferred resource reclamation.  Releasing a GPU resource the
+// moment the CPU is done with it requires proving the GPU is too, which has
+// meant a full FlushCommandQueue drain at every release site.  This queue
+// decouples the two: a resource is handed over together with the value on
+// the app's main queue fence that covers its last use, and Collect - called
+// once per frame with the fence's completed value - drops the reference
+// only after the GPU has passed it.  Releases then ride the pipeline
+// instead of draining it, which is what resizes, uploader disposal, and
+// streaming evictions need.
+//***************************************************************************************
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <windows.h>
+#include <wrl.h>
+
+class DeferredDeleter
+{
+public:
+
+    DeferredDeleter(const DeferredDeleter& rhs) = delete;
+    DeferredDeleter& operator=(const DeferredDeleter& rhs) = delete;
+
+    static DeferredDeleter& Instance();
+
+    ///<summary>
+    /// Queues a resource for release once fenceValue (on the app's main
+    /// queue fence) has completed.  The caller drops its own reference
+    /// after this; null resources are ignored.  Safe from any thread.
+    ///</summary>
+    void Defer(Microsoft::WRL::ComPtr<IUnknown> resource, UINT64 fenceValue);
+
+    ///<summary>
+    /// Releases every queued resource whose fence the GPU has passed.
+    /// Called once per frame from the render loop, and from
+    /// FlushCommandQueue, where everything queued becomes reclaimable.
+    /// Deferred ID3D12Resources are unregistered from the GPU memory
+    /// tracker as they go.
+    ///</summary>
+    void Collect(UINT64 completedFence);
+
+private:
+
+    DeferredDeleter() = default;
+
+    struct Entry
+    {
+        Microsoft::WRL::ComPtr<IUnknown> Resource;
+        UINT64 FenceValue = 0;
+    };
+
+    std::mutex mMutex;
+    std::vector<Entry> mEntries;
+};
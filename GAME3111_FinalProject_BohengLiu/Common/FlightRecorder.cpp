@@ -0,0 +1,97 @@
+//***************************************************************************************
+// FlightRecorder.cpp
+//***************************************************************************************
+
+#include "FlightRecorder.h"
+
+#include <ctime>
+#include <fstream>
+#include <sstream>
+
+FlightRecorder& FlightRecorder::Instance()
+{
+    static FlightRecorder instance;
+    return instance;
+}
+
+void FlightRecorder::SetGpuPass(const char* name, double ms)
+{
+    mPendingGpu.push_back({name, ms});
+}
+
+void FlightRecorder::EndFrame(double frameMs)
+{
+    Frame& frame = mRing[mFrameIndex % FrameHistory];
+    frame.Index = mFrameIndex;
+    frame.FrameMs = frameMs;
+    frame.Cpu = CpuProfiler::Instance().LastFrameTotals();
+    frame.Gpu.swap(mPendingGpu);
+    mPendingGpu.clear();
+
+    ++mFrameIndex;
+
+    if (mCooldownFrames > 0)
+    {
+        --mCooldownFrames;
+        return;
+    }
+
+    if (frameMs > mHitchThresholdMs)
+    {
+        DumpHitch(frame);
+        mCooldownFrames = FrameHistory;
+    }
+}
+
+void FlightRecorder::DumpHitch(const Frame& spike)
+{
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(2);
+
+    time_t now = time(nullptr);
+    tm local;
+    localtime_s(&local, &now);
+    char stamp[64];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+
+    out << "=== Hitch at " << stamp << ": frame " << spike.Index
+        << " took " << spike.FrameMs << " ms (threshold "
+        << mHitchThresholdMs << ") ===\n";
+
+    // The ring, oldest first; until the first wrap only the frames
+    // recorded so far exist.
+    out << "Frame history:\n";
+    const UINT64 first = mFrameIndex > FrameHistory ? mFrameIndex - FrameHistory : 0;
+    for (UINT64 i = first; i < mFrameIndex; ++i)
+    {
+        const Frame& frame = mRing[i % FrameHistory];
+        out << "  frame " << frame.Index << "  " << frame.FrameMs << " ms";
+        if (frame.Index == spike.Index)
+            out << "  <-- spike";
+        out << "\n";
+    }
+
+    out << "Spike frame CPU stages:\n";
+    for (const auto& stage : spike.Cpu)
+    {
+        out << "  ";
+        for (int d = 0; d < stage.Depth; ++d)
+            out << "  ";
+        size_t slash = stage.Path.find_last_of('/');
+        out << (slash == std::string::npos ? stage.Path : stage.Path.substr(slash + 1))
+            << "  " << stage.Ms << " ms\n";
+    }
+
+    out << "Spike frame GPU passes (pipeline-depth frames behind):\n";
+    for (const auto& pass : spike.Gpu)
+        out << "  " << pass.first << "  " << pass.second << " ms\n";
+
+    out << "\n";
+
+    std::ofstream fout("hitch_log.txt", std::ios::app);
+    if (fout)
+        fout << out.str();
+
+    OutputDebugStringA(out.str().c_str());
+}
@@ -0,0 +1,75 @@
+//***************************************************************************************
+// FlightRecorder.h
+//
+// Hitch diagnosis for the field.  The once-per-second averaging in
+// CalculateFrameStats hides a single 50 ms spike completely, and by the
+// time a profiler is attached the hitch is gone.  The recorder keeps the
+// last couple of seconds of per-frame CPU stage totals (from the
+// CpuProfiler scopes) and GPU pass timings in a ring; when a frame runs
+// past the hitch threshold it appends the whole ring plus the spike
+// frame's full breakdown to a log file, so the frames leading into the
+// hitch are captured without anything attached.
+//***************************************************************************************
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <windows.h>
+
+#include "CpuProfiler.h"
+
+class FlightRecorder
+{
+public:
+
+    FlightRecorder(const FlightRecorder& rhs) = delete;
+    FlightRecorder& operator=(const FlightRecorder& rhs) = delete;
+
+    static FlightRecorder& Instance();
+
+    ///<summary>
+    /// Records one GPU pass time for the frame being built.  The app feeds
+    /// these from its timestamp readbacks; they lag the CPU timings by the
+    /// pipeline depth, which a hitch log can tolerate.
+    ///</summary>
+    void SetGpuPass(const char* name, double ms);
+
+    ///<summary>
+    /// Closes the frame: snapshots the CpuProfiler's last-frame totals and
+    /// the pending GPU passes into the ring, and dumps the ring to the log
+    /// when frameMs crossed the hitch threshold.  Call once per frame,
+    /// right after CpuProfiler::EndFrame.
+    ///</summary>
+    void EndFrame(double frameMs);
+
+private:
+
+    FlightRecorder() = default;
+
+    // Two seconds of history at 60 Hz; long enough to see what led into
+    // the hitch, small enough that the per-frame snapshot stays cheap.
+    static const int FrameHistory = 120;
+
+    struct Frame
+    {
+        UINT64 Index = 0;
+        double FrameMs = 0.0;
+        std::vector<CpuProfiler::FrameTotal> Cpu;
+        std::vector<std::pair<std::string, double>> Gpu;
+    };
+
+    void DumpHitch(const Frame& spike);
+
+    Frame mRing[FrameHistory];
+    UINT64 mFrameIndex = 0;
+
+    std::vector<std::pair<std::string, double>> mPendingGpu;
+
+    // A single bad stretch would otherwise dump on every slow frame; after
+    // a dump the recorder stays quiet until the ring has fully refilled.
+    int mCooldownFrames = 0;
+
+    double mHitchThresholdMs = 40.0;
+};
@@ -0,0 +1,130 @@
+//***************************************************************************************
+// FrameArena.h
+//
+// Per-frame linear allocator for transient CPU memory - the system-memory
+// counterpart of UploadRing.  Each FrameResource owns one; the frame loop's
+// scratch containers (visible lists, sort scratch) suballocate from it
+// through FrameArenaAllocator instead of the global heap, so steady-state
+// rendering performs no global allocations.  A frame that outgrows its pages
+// chains a fresh one on, so capacity follows demand; Reset rewinds to the
+// first page once the owning frame's fence has passed.
+//***************************************************************************************
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class FrameArena
+{
+public:
+
+    explicit FrameArena(size_t pageSize = 64 * 1024)
+        : mPageSize(pageSize)
+    {
+        AddPage();
+    }
+
+    FrameArena(const FrameArena& rhs) = delete;
+    FrameArena& operator=(const FrameArena& rhs) = delete;
+
+    ///<summary>
+    /// Rewinds the allocator to the start of its first page.  Call once per
+    /// frame, after the owning FrameResource's fence wait; everything handed
+    /// out since the previous Reset is dead from then on.
+    ///</summary>
+    void Reset()
+    {
+        mCurPage = 0;
+        mCurOffset = 0;
+    }
+
+    ///<summary>
+    /// Reserves byteSize bytes at the given alignment.  Individual blocks are
+    /// never freed; the memory is reclaimed wholesale by the next Reset.
+    ///</summary>
+    void* Allocate(size_t byteSize, size_t alignment)
+    {
+        assert(byteSize <= mPageSize && "FrameArena allocation larger than a page");
+
+        size_t offset = (mCurOffset + alignment - 1) & ~(alignment - 1);
+
+        // Current page exhausted: move to the next, chaining a fresh page on
+        // first use.  Pages persist across frames, so steady-state allocation
+        // never touches the heap.
+        if(offset + byteSize > mPageSize)
+        {
+            ++mCurPage;
+            if(mCurPage == mPages.size())
+                AddPage();
+            offset = 0;
+        }
+
+        mCurOffset = offset + byteSize;
+        return mPages[mCurPage].get() + offset;
+    }
+
+private:
+
+    void AddPage()
+    {
+        mPages.push_back(std::unique_ptr<unsigned char[]>(new unsigned char[mPageSize]));
+    }
+
+    size_t mPageSize = 0;
+
+    std::vector<std::unique_ptr<unsigned char[]>> mPages;
+    size_t mCurPage = 0;
+    size_t mCurOffset = 0;
+};
+
+// STL-compatible allocator over a FrameArena, so the frame loop can keep
+// using std::vector for its scratch lists.  Deallocation is a no-op; a
+// container bound to an arena must be rebuilt (not just cleared) each frame,
+// since Reset pulls the memory out from under any capacity it kept.
+template<typename T>
+class FrameArenaAllocator
+{
+public:
+    using value_type = T;
+
+    // Containers assigned a fresh per-frame instance must carry the new
+    // arena with them.
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    FrameArenaAllocator() = default;
+    explicit FrameArenaAllocator(FrameArena* arena) : mArena(arena) {}
+
+    template<typename U>
+    FrameArenaAllocator(const FrameArenaAllocator<U>& rhs) : mArena(rhs.Arena()) {}
+
+    T* allocate(size_t n)
+    {
+        assert(mArena != nullptr && "FrameArenaAllocator used before being bound to an arena");
+        return reinterpret_cast<T*>(mArena->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t)
+    {
+        // Linear arena: nothing comes back until Reset.
+    }
+
+    FrameArena* Arena()const { return mArena; }
+
+    template<typename U>
+    bool operator==(const FrameArenaAllocator<U>& rhs)const { return mArena == rhs.Arena(); }
+
+    template<typename U>
+    bool operator!=(const FrameArenaAllocator<U>& rhs)const { return mArena != rhs.Arena(); }
+
+private:
+    FrameArena* mArena = nullptr;
+};
+
+// The frame loop's scratch container type.
+template<typename T>
+using FrameVector = std::vector<T, FrameArenaAllocator<T>>;
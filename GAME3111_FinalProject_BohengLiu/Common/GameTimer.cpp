@@ -6,7 +6,7 @@
 #include "GameTimer.h"
 
 GameTimer::GameTimer()
-: mSecondsPerCount(0.0), mDeltaTime(-1.0), mBaseTime(0), 
+: mSecondsPerCount(0.0), mDeltaTime(-1.0), mFixedStep(0.0), mBaseTime(0),
   mPausedTime(0), mPrevTime(0), mCurrTime(0), mStopped(false)
 {
 	__int64 countsPerSec;
@@ -98,6 +98,11 @@ void GameTimer::Stop()
 	}
 }
 
+void GameTimer::SetFixedStep(float dt)
+{
+	mFixedStep = (double)dt;
+}
+
 void GameTimer::Tick()
 {
 	if( mStopped )
@@ -106,6 +111,16 @@ void GameTimer::Tick()
 		return;
 	}
 
+	// Fixed-step mode: advance the clock by the scripted amount so both
+	// DeltaTime and TotalTime follow the deterministic timeline.
+	if( mFixedStep > 0.0 )
+	{
+		mCurrTime += (__int64)(mFixedStep / mSecondsPerCount);
+		mPrevTime = mCurrTime;
+		mDeltaTime = mFixedStep;
+		return;
+	}
+
 	__int64 currTime;
 	QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
 	mCurrTime = currTime;
@@ -18,9 +18,15 @@ public:
 	void Stop();  // Call when paused.
 	void Tick();  // Call every frame.
 
+	// When a fixed step is set, Tick advances the clock by exactly that
+	// amount every frame instead of reading the wall clock, so a scripted
+	// benchmark run is deterministic between builds.
+	void SetFixedStep(float dt);
+
 private:
 	double mSecondsPerCount;
 	double mDeltaTime;
+	double mFixedStep;
 
 	__int64 mBaseTime;
 	__int64 mPausedTime;
@@ -4,6 +4,9 @@
 
 #include "GeometryGenerator.h"
 #include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <unordered_map>
 
 using namespace DirectX;
 
@@ -211,14 +214,206 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
     return meshData;
 }
  
+void GeometryGenerator::MeshData::OptimizeForVertexCache()
+{
+	const uint32 numIndices = (uint32)Indices32.size();
+	const uint32 numTris = numIndices/3;
+	const uint32 numVerts = (uint32)Vertices.size();
+
+	if(numTris == 0)
+		return;
+
+	// Tom Forsyth's linear-speed vertex cache optimization.  Triangles are
+	// emitted greedily by score, where a vertex scores higher the nearer it
+	// sits in a simulated FIFO cache and the fewer unemitted triangles still
+	// reference it.
+
+	const int CacheSize = 32;
+	const float CacheDecayPower = 1.5f;
+	const float LastTriScore = 0.75f;
+	const float ValenceBoostScale = 2.0f;
+	const float ValenceBoostPower = 0.5f;
+
+	auto vertexScore = [&](int cachePos, uint32 activeTris) -> float
+	{
+		// No triangle needs this vertex any more.
+		if(activeTris == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if(cachePos < 0)
+		{
+			// Not in cache; only the valence boost below applies.
+		}
+		else if(cachePos < 3)
+		{
+			// Used by the previous triangle.  A fixed score avoids favoring
+			// thin strips over fans.
+			score = LastTriScore;
+		}
+		else
+		{
+			const float scaler = 1.0f/(CacheSize - 3);
+			score = 1.0f - (cachePos - 3)*scaler;
+			score = powf(score, CacheDecayPower);
+		}
+
+		// Bonus for nearly finished vertices so isolated corners get closed
+		// out instead of lingering.
+		score += ValenceBoostScale*powf((float)activeTris, -ValenceBoostPower);
+		return score;
+	};
+
+	// Per-vertex triangle adjacency in flat arrays.
+	std::vector<uint32> remainingTris(numVerts, 0);
+	for(uint32 i = 0; i < numIndices; ++i)
+		remainingTris[Indices32[i]]++;
+
+	std::vector<uint32> triOffset(numVerts + 1, 0);
+	for(uint32 v = 0; v < numVerts; ++v)
+		triOffset[v + 1] = triOffset[v] + remainingTris[v];
+
+	std::vector<uint32> triLists(numIndices);
+	{
+		std::vector<uint32> fill(numVerts, 0);
+		for(uint32 t = 0; t < numTris; ++t)
+		{
+			for(int k = 0; k < 3; ++k)
+			{
+				uint32 v = Indices32[t*3 + k];
+				triLists[triOffset[v] + fill[v]++] = t;
+			}
+		}
+	}
+
+	std::vector<float> vertScore(numVerts);
+	for(uint32 v = 0; v < numVerts; ++v)
+		vertScore[v] = vertexScore(-1, remainingTris[v]);
+
+	std::vector<bool> triEmitted(numTris, false);
+	std::vector<float> triScore(numTris);
+	for(uint32 t = 0; t < numTris; ++t)
+	{
+		triScore[t] = vertScore[Indices32[t*3 + 0]] +
+		              vertScore[Indices32[t*3 + 1]] +
+		              vertScore[Indices32[t*3 + 2]];
+	}
+
+	std::vector<uint32> newIndices;
+	newIndices.reserve(numIndices);
+
+	// Simulated cache, most recently used first.  May briefly exceed
+	// CacheSize while the new triangle's vertices are pushed.
+	std::vector<uint32> cache;
+	cache.reserve(CacheSize + 3);
+
+	uint32 emittedCount = 0;
+	int bestTri = -1;
+	while(emittedCount < numTris)
+	{
+		if(bestTri < 0)
+		{
+			// Full scan; happens at the start and whenever the cache
+			// neighborhood runs out of triangles.
+			float best = -FLT_MAX;
+			for(uint32 t = 0; t < numTris; ++t)
+			{
+				if(!triEmitted[t] && triScore[t] > best)
+				{
+					best = triScore[t];
+					bestTri = (int)t;
+				}
+			}
+		}
+
+		uint32 tri = (uint32)bestTri;
+		triEmitted[tri] = true;
+		++emittedCount;
+
+		for(int k = 0; k < 3; ++k)
+		{
+			uint32 v = Indices32[tri*3 + k];
+			newIndices.push_back(v);
+			remainingTris[v]--;
+
+			// Move v to the front of the simulated cache.
+			auto it = std::find(cache.begin(), cache.end(), v);
+			if(it != cache.end())
+				cache.erase(it);
+			cache.insert(cache.begin(), v);
+		}
+
+		// Rescore every vertex the cache touched (including the ones about
+		// to fall out) and track the best triangle they reference.
+		bestTri = -1;
+		float best = -FLT_MAX;
+		for(size_t c = 0; c < cache.size(); ++c)
+		{
+			uint32 v = cache[c];
+
+			int pos = c < (size_t)CacheSize ? (int)c : -1;
+			float newScore = vertexScore(pos, remainingTris[v]);
+			float delta = newScore - vertScore[v];
+			vertScore[v] = newScore;
+
+			for(uint32 i = triOffset[v]; i < triOffset[v + 1]; ++i)
+			{
+				uint32 t = triLists[i];
+				if(triEmitted[t])
+					continue;
+
+				triScore[t] += delta;
+				if(triScore[t] > best)
+				{
+					best = triScore[t];
+					bestTri = (int)t;
+				}
+			}
+		}
+
+		while(cache.size() > (size_t)CacheSize)
+			cache.pop_back();
+	}
+
+	Indices32.swap(newIndices);
+	mIndices16.clear();
+}
+
 void GeometryGenerator::Subdivide(MeshData& meshData)
 {
-	// Save a copy of the input geometry.
-	MeshData inputCopy = meshData;
+	// Move the input indices aside; the vertices stay in place and are only
+	// appended to, so a midpoint shared by two triangles is emitted once.
+	std::vector<uint32> inputIndices;
+	inputIndices.swap(meshData.Indices32);
+
+	uint32 numTris = (uint32)inputIndices.size()/3;
+
+	// On a closed mesh every edge is shared by two triangles, so one
+	// subdivision adds 3*numTris/2 midpoints and quadruples the indices.
+	// Reserve up front so neither vector regrows during the loop.
+	meshData.Vertices.reserve(meshData.Vertices.size() + numTris*3/2 + 3);
+	meshData.Indices32.reserve(inputIndices.size()*4);
 
+	// Maps an edge, keyed by its packed endpoint indices, to the index of
+	// its midpoint vertex.
+	std::unordered_map<std::uint64_t, uint32> midpointCache;
+	midpointCache.reserve(numTris*3/2 + 3);
 
-	meshData.Vertices.resize(0);
-	meshData.Indices32.resize(0);
+	auto midpointIndex = [&meshData, &midpointCache](uint32 i0, uint32 i1) -> uint32
+	{
+		std::uint64_t key = i0 < i1 ?
+			((std::uint64_t)i0 << 32) | i1 :
+			((std::uint64_t)i1 << 32) | i0;
+
+		auto it = midpointCache.find(key);
+		if(it != midpointCache.end())
+			return it->second;
+
+		uint32 index = (uint32)meshData.Vertices.size();
+		meshData.Vertices.push_back(MidPoint(meshData.Vertices[i0], meshData.Vertices[i1]));
+		midpointCache[key] = index;
+		return index;
+	};
 
 	//       v1
 	//       *
@@ -230,47 +425,40 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 	// *-----*-----*
 	// v0    m2     v2
 
-	uint32 numTris = (uint32)inputCopy.Indices32.size()/3;
 	for(uint32 i = 0; i < numTris; ++i)
 	{
-		Vertex v0 = inputCopy.Vertices[ inputCopy.Indices32[i*3+0] ];
-		Vertex v1 = inputCopy.Vertices[ inputCopy.Indices32[i*3+1] ];
-		Vertex v2 = inputCopy.Vertices[ inputCopy.Indices32[i*3+2] ];
+		uint32 v0 = inputIndices[i*3+0];
+		uint32 v1 = inputIndices[i*3+1];
+		uint32 v2 = inputIndices[i*3+2];
 
 		//
-		// Generate the midpoints.
+		// Generate the midpoints, reusing any already emitted for a
+		// neighboring triangle.
 		//
 
-        Vertex m0 = MidPoint(v0, v1);
-        Vertex m1 = MidPoint(v1, v2);
-        Vertex m2 = MidPoint(v0, v2);
+		uint32 m0 = midpointIndex(v0, v1);
+		uint32 m1 = midpointIndex(v1, v2);
+		uint32 m2 = midpointIndex(v0, v2);
 
 		//
 		// Add new geometry.
 		//
 
-		meshData.Vertices.push_back(v0); // 0
-		meshData.Vertices.push_back(v1); // 1
-		meshData.Vertices.push_back(v2); // 2
-		meshData.Vertices.push_back(m0); // 3
-		meshData.Vertices.push_back(m1); // 4
-		meshData.Vertices.push_back(m2); // 5
- 
-		meshData.Indices32.push_back(i*6+0);
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+5);
+		meshData.Indices32.push_back(v0);
+		meshData.Indices32.push_back(m0);
+		meshData.Indices32.push_back(m2);
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+5);
+		meshData.Indices32.push_back(m0);
+		meshData.Indices32.push_back(m1);
+		meshData.Indices32.push_back(m2);
 
-		meshData.Indices32.push_back(i*6+5);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+2);
+		meshData.Indices32.push_back(m2);
+		meshData.Indices32.push_back(m1);
+		meshData.Indices32.push_back(v2);
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+1);
-		meshData.Indices32.push_back(i*6+4);
+		meshData.Indices32.push_back(m0);
+		meshData.Indices32.push_back(v1);
+		meshData.Indices32.push_back(m1);
 	}
 }
 
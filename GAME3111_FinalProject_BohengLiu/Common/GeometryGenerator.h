@@ -70,6 +70,13 @@ public:
 			return mIndices16;
         }
 
+		///<summary>
+		/// Reorders the index list with Forsyth's linear-speed algorithm so
+		/// triangle order favors the GPU post-transform vertex cache.  Call
+		/// before the mesh is uploaded; vertices are left untouched.
+		///</summary>
+		void OptimizeForVertexCache();
+
 	private:
 		std::vector<uint16> mIndices16;
 	};
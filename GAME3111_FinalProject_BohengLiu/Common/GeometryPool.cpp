@@ -0,0 +1,75 @@
+//***************************************************************************************
+// GeometryPool.cpp
+//***************************************************************************************
+
+#include "GeometryPool.h"
+
+#include <cassert>
+
+#include "GpuMemoryTracker.h"
+
+GeometryPool::GeometryPool(ID3D12Device* device, UINT64 vbByteSize, UINT64 ibByteSize)
+    : mVbByteSize(vbByteSize),
+      mIbByteSize(ibByteSize)
+{
+    // Created straight in copy-dest: the pool only ever fills during the
+    // init batch, then transitions to read state for good.
+    ThrowIfFailed(device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(vbByteSize),
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(mVertexBuffer.GetAddressOf())));
+    GpuMemoryTracker::Instance().Track(mVertexBuffer.Get(), GpuMemoryTracker::Category::Geometry);
+
+    ThrowIfFailed(device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(ibByteSize),
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(mIndexBuffer.GetAddressOf())));
+    GpuMemoryTracker::Instance().Track(mIndexBuffer.Get(), GpuMemoryTracker::Category::Geometry);
+}
+
+UINT GeometryPool::PlaceVertices(ID3D12GraphicsCommandList* cmdList, StagingArena* staging,
+                                 const void* data, UINT64 byteSize, UINT stride)
+{
+    // Align to the stride so the view's vertex zero lands on a whole vertex.
+    UINT64 offset = (mVbOffset + stride - 1) / stride * stride;
+
+    // Sized by the caller for the whole scene; running out means the
+    // estimate needs raising, not a silent fallback.
+    assert(offset + byteSize <= mVbByteSize && "GeometryPool vertex buffer exhausted");
+
+    staging->StageCopy(cmdList, mVertexBuffer.Get(), offset, data, byteSize);
+
+    mVbOffset = offset + byteSize;
+    return (UINT)offset;
+}
+
+UINT GeometryPool::PlaceIndices(ID3D12GraphicsCommandList* cmdList, StagingArena* staging,
+                                const void* data, UINT64 byteSize)
+{
+    UINT64 offset = (mIbOffset + 3) & ~UINT64(3);
+
+    assert(offset + byteSize <= mIbByteSize && "GeometryPool index buffer exhausted");
+
+    staging->StageCopy(cmdList, mIndexBuffer.Get(), offset, data, byteSize);
+
+    mIbOffset = offset + byteSize;
+    return (UINT)offset;
+}
+
+void GeometryPool::TransitionToRead(ID3D12GraphicsCommandList* cmdList)
+{
+    CD3DX12_RESOURCE_BARRIER barriers[] =
+    {
+        CD3DX12_RESOURCE_BARRIER::Transition(mVertexBuffer.Get(),
+            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ),
+        CD3DX12_RESOURCE_BARRIER::Transition(mIndexBuffer.Get(),
+            D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ)
+    };
+    cmdList->ResourceBarrier(_countof(barriers), barriers);
+}
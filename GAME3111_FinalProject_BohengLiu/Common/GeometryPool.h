@@ -0,0 +1,60 @@
+//***************************************************************************************
+// GeometryPool.h
+//
+// One large default-heap vertex buffer and one index buffer that every
+// static mesh suballocates from.  MeshGeometry views point into the shared
+// resources at per-mesh byte offsets (the SubmeshGeometry offsets inside
+// each mesh keep working unchanged), so static geometry lives in two
+// contiguous GPU allocations instead of two committed resources per mesh,
+// and a draw from a "different" mesh no longer forces new buffer binds.
+// The pool is filled during initialization through the staging arena and
+// flips to read state once, after every mesh has been placed.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "StagingArena.h"
+
+class GeometryPool
+{
+public:
+
+    GeometryPool(ID3D12Device* device, UINT64 vbByteSize, UINT64 ibByteSize);
+    GeometryPool(const GeometryPool& rhs) = delete;
+    GeometryPool& operator=(const GeometryPool& rhs) = delete;
+
+    ID3D12Resource* VertexBuffer()const { return mVertexBuffer.Get(); }
+    ID3D12Resource* IndexBuffer()const { return mIndexBuffer.Get(); }
+
+    ///<summary>
+    /// Stages the vertex data through the arena into the pooled vertex
+    /// buffer and returns the byte offset of the placed run, aligned to the
+    /// stride so the mesh's vertex zero sits on a whole vertex.
+    ///</summary>
+    UINT PlaceVertices(ID3D12GraphicsCommandList* cmdList, StagingArena* staging,
+                       const void* data, UINT64 byteSize, UINT stride);
+
+    ///<summary>
+    /// Stages the index data through the arena into the pooled index buffer
+    /// and returns the byte offset of the placed run.
+    ///</summary>
+    UINT PlaceIndices(ID3D12GraphicsCommandList* cmdList, StagingArena* staging,
+                      const void* data, UINT64 byteSize);
+
+    ///<summary>
+    /// Transitions both pooled buffers from copy-dest to read state.  Call
+    /// once, after the last placement has been recorded.
+    ///</summary>
+    void TransitionToRead(ID3D12GraphicsCommandList* cmdList);
+
+private:
+
+    Microsoft::WRL::ComPtr<ID3D12Resource> mVertexBuffer;
+    Microsoft::WRL::ComPtr<ID3D12Resource> mIndexBuffer;
+
+    UINT64 mVbByteSize = 0;
+    UINT64 mIbByteSize = 0;
+    UINT64 mVbOffset = 0;
+    UINT64 mIbOffset = 0;
+};
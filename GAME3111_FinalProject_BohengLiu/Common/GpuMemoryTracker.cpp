@@ -0,0 +1,119 @@
+//***************************************************************************************
+// GpuMemoryTracker.cpp
+//***************************************************************************************
+
+#include "GpuMemoryTracker.h"
+
+GpuMemoryTracker& GpuMemoryTracker::Instance()
+{
+    static GpuMemoryTracker instance;
+    return instance;
+}
+
+void GpuMemoryTracker::SetAdapter(IDXGIAdapter3* adapter)
+{
+    mAdapter = adapter;
+    QueryBudget();
+}
+
+void GpuMemoryTracker::Track(ID3D12Resource* resource, Category cat)
+{
+    if (resource == nullptr)
+        return;
+
+    // Charge what the device actually allocates for the desc; small and
+    // MSAA resources pad well past their logical byte counts.
+    Microsoft::WRL::ComPtr<ID3D12Device> device;
+    ThrowIfFailed(resource->GetDevice(IID_PPV_ARGS(&device)));
+
+    D3D12_RESOURCE_DESC desc = resource->GetDesc();
+    const UINT64 bytes = device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries[resource] = {cat, bytes};
+    mCategoryBytes[(int)cat] += bytes;
+}
+
+void GpuMemoryTracker::Untrack(ID3D12Resource* resource)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto it = mEntries.find(resource);
+    if (it == mEntries.end())
+        return;
+
+    mCategoryBytes[(int)it->second.Cat] -= it->second.Bytes;
+    mEntries.erase(it);
+}
+
+void GpuMemoryTracker::QueryBudget()
+{
+    if (mAdapter == nullptr)
+        return;
+
+    DXGI_QUERY_VIDEO_MEMORY_INFO info = {};
+    if (SUCCEEDED(mAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info)))
+    {
+        mUsage = info.CurrentUsage;
+        mBudget = info.Budget;
+    }
+}
+
+UINT64 GpuMemoryTracker::CategoryBytes(Category cat) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCategoryBytes[(int)cat];
+}
+
+UINT64 GpuMemoryTracker::TrackedBytes() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    UINT64 total = 0;
+    for (int i = 0; i < (int)Category::Count; ++i)
+        total += mCategoryBytes[i];
+    return total;
+}
+
+bool GpuMemoryTracker::NearBudget() const
+{
+    // 90% leaves the driver room for its own surfaces before the OS starts
+    // demoting ours; warning at the budget itself would be too late.
+    return mBudget != 0 && mUsage > mBudget - mBudget / 10;
+}
+
+std::string GpuMemoryTracker::BuildReport() const
+{
+    static const char* categoryNames[(int)Category::Count] =
+    {
+        "textures", "geometry", "render targets", "upload", "readback", "other"
+    };
+
+    UINT64 bytes[(int)Category::Count];
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        memcpy(bytes, mCategoryBytes, sizeof(bytes));
+    }
+
+    const double mb = 1.0 / (1024.0 * 1024.0);
+
+    std::string report = "GPU memory:\n";
+    char line[128];
+
+    UINT64 tracked = 0;
+    for (int i = 0; i < (int)Category::Count; ++i)
+    {
+        tracked += bytes[i];
+        sprintf_s(line, "  %-14s %8.1f MB\n", categoryNames[i], bytes[i] * mb);
+        report += line;
+    }
+
+    sprintf_s(line, "  %-14s %8.1f MB\n", "tracked", tracked * mb);
+    report += line;
+
+    sprintf_s(line, "  OS usage %.1f MB of %.1f MB budget%s\n",
+              mUsage * mb, mBudget * mb, NearBudget() ? "  ** NEAR BUDGET **" : "");
+    report += line;
+
+    return report;
+}
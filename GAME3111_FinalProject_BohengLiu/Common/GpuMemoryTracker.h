@@ -0,0 +1,92 @@
+//***************************************************************************************
+// GpuMemoryTracker.h
+//
+// Video memory accounting plus OS budget reporting.  Long-lived GPU
+// allocations are tagged with a category as they are created (Track) and
+// removed when they are recreated or released (Untrack), so the per-category
+// byte totals say where the VRAM went.  Once per frame the app refreshes the
+// adapter's DXGI_QUERY_VIDEO_MEMORY_INFO: the OS budget is a soft limit -
+// crossing it does not fail allocations, it starts invisible paging - so
+// NearBudget() flips to a warning state while there is still headroom.
+//***************************************************************************************
+
+#pragma once
+
+#include <dxgi1_4.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "d3dUtil.h"
+
+class GpuMemoryTracker
+{
+public:
+
+    enum class Category : int
+    {
+        Textures = 0,
+        Geometry,
+        RenderTargets,
+        Upload,
+        Readback,
+        Other,
+        Count
+    };
+
+    GpuMemoryTracker(const GpuMemoryTracker& rhs) = delete;
+    GpuMemoryTracker& operator=(const GpuMemoryTracker& rhs) = delete;
+
+    static GpuMemoryTracker& Instance();
+
+    // Hands the tracker the adapter the device was created on.  Budget
+    // queries stay disabled (and NearBudget stays false) until this is set.
+    void SetAdapter(IDXGIAdapter3* adapter);
+
+    // Records a created resource under a category.  The charged size is the
+    // device's allocation size for the desc rather than the logical byte
+    // count, so alignment padding is accounted too.  Safe from any thread;
+    // the parallel init stages create resources concurrently.
+    void Track(ID3D12Resource* resource, Category cat);
+
+    // Removes a tracked resource, e.g. before a resize recreates a target.
+    // Unknown resources are ignored so release paths can call this
+    // unconditionally.
+    void Untrack(ID3D12Resource* resource);
+
+    // Refreshes the OS local-memory usage and budget.  Cheap; call once per
+    // frame from the frame loop.
+    void QueryBudget();
+
+    UINT64 CategoryBytes(Category cat) const;
+    UINT64 TrackedBytes() const;
+
+    // Process usage and budget as the OS last reported them, in bytes.
+    UINT64 UsageBytes() const { return mUsage; }
+    UINT64 BudgetBytes() const { return mBudget; }
+
+    // True once usage crosses the warning fraction of the budget; the next
+    // stop past the budget itself is demotion to system memory.
+    bool NearBudget() const;
+
+    // One line per category plus the OS numbers, for OutputDebugString.
+    std::string BuildReport() const;
+
+private:
+
+    GpuMemoryTracker() = default;
+
+    struct Entry
+    {
+        Category Cat = Category::Other;
+        UINT64 Bytes = 0;
+    };
+
+    mutable std::mutex mMutex;
+    std::unordered_map<ID3D12Resource*, Entry> mEntries;
+    UINT64 mCategoryBytes[(int)Category::Count] = {};
+
+    Microsoft::WRL::ComPtr<IDXGIAdapter3> mAdapter;
+    UINT64 mUsage = 0;
+    UINT64 mBudget = 0;
+};
@@ -0,0 +1,180 @@
+//***************************************************************************************
+// JobSystem.cpp
+//***************************************************************************************
+
+#include "JobSystem.h"
+
+#include <chrono>
+
+JobSystem::JobSystem(int workerCount)
+{
+    if (workerCount <= 0)
+        workerCount = (int)std::thread::hardware_concurrency() - 1;
+    if (workerCount < 1)
+        workerCount = 1;
+
+    for (int i = 0; i < workerCount; ++i)
+        mWorkers.push_back(std::make_unique<Worker>());
+
+    for (int i = 0; i < workerCount; ++i)
+        mThreads.emplace_back(&JobSystem::WorkerLoop, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    mQuit = true;
+    mWake.notify_all();
+    for (auto& t : mThreads)
+        t.join();
+}
+
+void JobSystem::Submit(std::function<void()> job)
+{
+    // Round-robin across the queues; stealing evens out any imbalance.
+    Worker& worker = *mWorkers[mNextQueue++ % mWorkers.size()];
+    {
+        std::lock_guard<std::mutex> lock(worker.Mutex);
+        worker.Queue.push_back(std::move(job));
+    }
+
+    ++mPendingJobs;
+    mWake.notify_one();
+}
+
+bool JobSystem::PopJob(int preferred, std::function<void()>& job)
+{
+    // The owner drains its own queue newest-first; every other queue is
+    // robbed oldest-first, so a thief takes the work the owner would reach
+    // last.
+    const int count = (int)mWorkers.size();
+    for (int n = 0; n < count; ++n)
+    {
+        const int i = (preferred + n) % count;
+        Worker& worker = *mWorkers[i];
+
+        std::lock_guard<std::mutex> lock(worker.Mutex);
+        if (worker.Queue.empty())
+            continue;
+
+        if (i == preferred)
+        {
+            job = std::move(worker.Queue.back());
+            worker.Queue.pop_back();
+        }
+        else
+        {
+            job = std::move(worker.Queue.front());
+            worker.Queue.pop_front();
+        }
+
+        --mPendingJobs;
+        return true;
+    }
+
+    return false;
+}
+
+bool JobSystem::TryRunOne()
+{
+    // External threads have no queue of their own; start stealing at 0.
+    std::function<void()> job;
+    if (!PopJob(0, job))
+        return false;
+
+    job();
+    return true;
+}
+
+void JobSystem::WorkerLoop(int index)
+{
+    std::function<void()> job;
+
+    while (!mQuit)
+    {
+        if (PopJob(index, job))
+        {
+            job();
+            job = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mWakeMutex);
+        mWake.wait(lock, [this] { return mQuit || mPendingJobs > 0; });
+    }
+}
+
+JobGraph::JobGraph(JobSystem* jobSystem)
+    : mJobSystem(jobSystem)
+{
+}
+
+int JobGraph::AddTask(const char* name, std::function<void()> work)
+{
+    Task task;
+    task.Name = name;
+    task.Work = std::move(work);
+    mTasks.push_back(std::move(task));
+    return (int)mTasks.size() - 1;
+}
+
+void JobGraph::AddDependency(int before, int after)
+{
+    mTasks[before].Dependents.push_back(after);
+    ++mTasks[after].DependencyCount;
+}
+
+void JobGraph::RunTask(int index)
+{
+    mTasks[index].Work();
+
+    // Release the dependents under the lock, then submit outside it so a
+    // worker picking one up never contends with this bookkeeping.
+    std::vector<int> ready;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (int dependent : mTasks[index].Dependents)
+        {
+            if (--mTasks[dependent].Pending == 0)
+                ready.push_back(dependent);
+        }
+        --mRemaining;
+    }
+
+    for (int dependent : ready)
+        mJobSystem->Submit([this, dependent] { RunTask(dependent); });
+
+    mDone.notify_all();
+}
+
+void JobGraph::Execute()
+{
+    if (mTasks.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRemaining = (int)mTasks.size();
+        for (auto& task : mTasks)
+            task.Pending = task.DependencyCount;
+    }
+
+    for (int i = 0; i < (int)mTasks.size(); ++i)
+    {
+        if (mTasks[i].DependencyCount == 0)
+            mJobSystem->Submit([this, i] { RunTask(i); });
+    }
+
+    // Help drain the pool rather than block; the short timed wait covers
+    // the window where the only runnable tasks are still executing
+    // elsewhere and new ones have not been released yet.
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (mRemaining > 0)
+    {
+        lock.unlock();
+        const bool ran = mJobSystem->TryRunOne();
+        lock.lock();
+
+        if (!ran && mRemaining > 0)
+            mDone.wait_for(lock, std::chrono::milliseconds(1), [this] { return mRemaining == 0; });
+    }
+}
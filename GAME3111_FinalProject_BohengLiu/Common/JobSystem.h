@@ -0,0 +1,120 @@
+//***************************************************************************************
+// JobSystem.h
+//
+// Small work-stealing thread pool plus a declared task graph on top of it.
+// Each worker owns a deque: it pushes and pops its own work LIFO for cache
+// warmth and steals FIFO from the others when it runs dry, so an uneven
+// task mix still spreads across cores.  JobGraph expresses a phase as named
+// tasks with explicit dependencies; Execute runs every task as soon as its
+// predecessors finish and returns when the whole graph has, with the
+// calling thread stealing work too instead of blocking idle.  The critical
+// path of the phase then shrinks to its longest dependency chain.
+//***************************************************************************************
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class JobSystem
+{
+public:
+
+    // Zero workers means one per hardware thread minus the caller's.
+    explicit JobSystem(int workerCount = 0);
+    JobSystem(const JobSystem& rhs) = delete;
+    JobSystem& operator=(const JobSystem& rhs) = delete;
+    ~JobSystem();
+
+    ///<summary>
+    /// Queues a job for any worker.  Jobs may submit further jobs.
+    ///</summary>
+    void Submit(std::function<void()> job);
+
+    ///<summary>
+    /// Steals and runs one queued job on the calling thread; returns false
+    /// when every queue is empty.  Lets a thread waiting on the pool help
+    /// drain it instead of sleeping.
+    ///</summary>
+    bool TryRunOne();
+
+    int WorkerCount() const { return (int)mThreads.size(); }
+
+private:
+
+    struct Worker
+    {
+        std::mutex Mutex;
+        std::deque<std::function<void()>> Queue;
+    };
+
+    void WorkerLoop(int index);
+    bool PopJob(int preferred, std::function<void()>& job);
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::vector<std::thread> mThreads;
+
+    // Jobs queued but not yet picked up; the wake predicate, so a submit
+    // racing a worker going to sleep is never lost.
+    std::atomic<int> mPendingJobs{0};
+    std::mutex mWakeMutex;
+    std::condition_variable mWake;
+    std::atomic<bool> mQuit{false};
+
+    std::atomic<unsigned> mNextQueue{0};
+};
+
+class JobGraph
+{
+public:
+
+    explicit JobGraph(JobSystem* jobSystem);
+    JobGraph(const JobGraph& rhs) = delete;
+    JobGraph& operator=(const JobGraph& rhs) = delete;
+
+    ///<summary>
+    /// Declares a task and returns its handle for dependency edges.  The
+    /// name only feeds profiling and debugging.
+    ///</summary>
+    int AddTask(const char* name, std::function<void()> work);
+
+    ///<summary>
+    /// Declares that task 'after' must not start until 'before' finished.
+    ///</summary>
+    void AddDependency(int before, int after);
+
+    ///<summary>
+    /// Runs the graph to completion.  Tasks with no unfinished
+    /// predecessors go to the pool immediately and each completion
+    /// releases its dependents; the calling thread steals work while it
+    /// waits.  The graph can be rebuilt and executed again afterwards.
+    ///</summary>
+    void Execute();
+
+private:
+
+    struct Task
+    {
+        std::string Name;
+        std::function<void()> Work;
+        std::vector<int> Dependents;
+        int DependencyCount = 0;
+        int Pending = 0;
+    };
+
+    void RunTask(int index);
+
+    JobSystem* mJobSystem = nullptr;
+    std::vector<Task> mTasks;
+
+    std::mutex mMutex;
+    std::condition_variable mDone;
+    int mRemaining = 0;
+};
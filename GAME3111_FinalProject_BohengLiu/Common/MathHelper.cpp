@@ -11,6 +11,20 @@ using namespace DirectX;
 const float MathHelper::Infinity = FLT_MAX;
 const float MathHelper::Pi       = 3.1415926535f;
 
+void MathHelper::Fill(float* dst, size_t n, float lo, float hi, uint32_t seed)
+{
+	// Each lane depends only on its counter, so the compiler is free to
+	// vectorize this loop; throughput is bounded by the stores.
+	float scale = (hi - lo)*(1.0f/16777216.0f);
+	for(size_t i = 0; i < n; ++i)
+	{
+		uint32_t state = (seed + (uint32_t)i)*747796405u + 2891336453u;
+		uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state)*277803737u;
+		word = (word >> 22u) ^ word;
+		dst[i] = lo + (word >> 8)*scale;
+	}
+}
+
 float MathHelper::AngleFromXY(float x, float y)
 {
 	float theta = 0.0f;
@@ -30,6 +30,25 @@ public:
         return a + rand() % ((b - a) + 1);
     }
 
+	// Counter-based PCG hash: each counter value maps to an independent
+	// 32-bit result with no shared state, so bulk generation stays
+	// branch-free and vectorizable, without rand()'s CRT locking.
+	static uint32_t PcgHash(uint32_t counter)
+	{
+		uint32_t state = counter*747796405u + 2891336453u;
+		uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state)*277803737u;
+		return (word >> 22u) ^ word;
+	}
+
+	// Returns the random float in [a, b) for the given counter value.
+	static float RandF(uint32_t counter, float a, float b)
+	{
+		return a + (PcgHash(counter) >> 8)*(1.0f/16777216.0f)*(b - a);
+	}
+
+	// Fills dst with n random floats in [lo, hi) from counters [seed, seed+n).
+	static void Fill(float* dst, size_t n, float lo, float hi, uint32_t seed = 0);
+
 	template<typename T>
 	static T Min(const T& a, const T& b)
 	{
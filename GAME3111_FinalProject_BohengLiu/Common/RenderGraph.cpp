@@ -0,0 +1,31 @@
+//***************************************************************************************
+// RenderGraph.cpp
+//***************************************************************************************
+
+#include "RenderGraph.h"
+
+void RenderGraph::Track(ID3D12Resource* resource, D3D12_RESOURCE_STATES state)
+{
+    mStates[resource] = state;
+}
+
+void RenderGraph::Use(ID3D12Resource* resource, D3D12_RESOURCE_STATES state)
+{
+    auto it = mStates.find(resource);
+    assert(it != mStates.end() && "Use on a resource the graph is not tracking");
+
+    if (it->second == state)
+        return;
+
+    mPending.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource, it->second, state));
+    it->second = state;
+}
+
+void RenderGraph::BeginPass(ID3D12GraphicsCommandList* cmdList)
+{
+    if (mPending.empty())
+        return;
+
+    cmdList->ResourceBarrier((UINT)mPending.size(), mPending.data());
+    mPending.clear();
+}
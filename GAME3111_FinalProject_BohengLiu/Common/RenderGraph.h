@@ -0,0 +1,58 @@
+//***************************************************************************************
+// RenderGraph.h
+//
+// Small frame-graph layer for pass-ordered rendering: passes declare which
+// resources they use and in what state, and the graph tracks current states
+// and submits the transitions as one batched ResourceBarrier call per pass
+// instead of one call per resource.  Pass order itself is fixed by the
+// recording code (the parallel layer lists execute in submission order), so
+// the graph's job is usage declaration, state tracking, and barrier
+// batching — the piece that keeps additional passes from hand-placing
+// transitions all over Draw.
+//***************************************************************************************
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "d3dUtil.h"
+
+class RenderGraph
+{
+public:
+
+    RenderGraph() = default;
+    RenderGraph(const RenderGraph& rhs) = delete;
+    RenderGraph& operator=(const RenderGraph& rhs) = delete;
+
+    ///<summary>
+    /// Registers a resource and the state it currently sits in.  Call again
+    /// after a resize recreates the resource; re-tracking an existing entry
+    /// overwrites its state.
+    ///</summary>
+    void Track(ID3D12Resource* resource, D3D12_RESOURCE_STATES state);
+
+    ///<summary>
+    /// Declares that the next pass uses the resource in the given state.
+    /// The transition, if one is needed, is queued until BeginPass flushes.
+    ///</summary>
+    void Use(ID3D12Resource* resource, D3D12_RESOURCE_STATES state);
+
+    ///<summary>
+    /// Flushes every queued transition as one batched ResourceBarrier call
+    /// and begins the pass.  Makes no API call when all declared states
+    /// already match.
+    ///</summary>
+    void BeginPass(ID3D12GraphicsCommandList* cmdList);
+
+private:
+
+    // Current state per tracked resource, persistent across frames; each
+    // frame's passes walk the resources back to their steady states, so no
+    // per-frame reseed is needed.
+    std::unordered_map<ID3D12Resource*, D3D12_RESOURCE_STATES> mStates;
+
+    // Transitions queued by Use since the last BeginPass.
+    std::vector<D3D12_RESOURCE_BARRIER> mPending;
+};
@@ -0,0 +1,90 @@
+//***************************************************************************************
+// StagingArena.cpp
+//***************************************************************************************
+
+#include "StagingArena.h"
+
+#include <cassert>
+
+#include "GpuMemoryTracker.h"
+
+using Microsoft::WRL::ComPtr;
+
+StagingArena::StagingArena(ID3D12Device* device, UINT64 byteSize)
+    : md3dDevice(device),
+      mByteSize(byteSize)
+{
+    ThrowIfFailed(device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(mUploadBuffer.GetAddressOf())));
+    GpuMemoryTracker::Instance().Track(mUploadBuffer.Get(), GpuMemoryTracker::Category::Upload);
+
+    ThrowIfFailed(mUploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+}
+
+StagingArena::~StagingArena()
+{
+    // The arena is released once the init batch retires, so its staging
+    // memory should drop out of the accounting with it.
+    GpuMemoryTracker::Instance().Untrack(mUploadBuffer.Get());
+
+    if(mUploadBuffer != nullptr)
+        mUploadBuffer->Unmap(0, nullptr);
+
+    mMappedData = nullptr;
+}
+
+UINT64 StagingArena::Suballocate(UINT64 byteSize, UINT64 alignment)
+{
+    UINT64 offset = (mOffset + alignment - 1) & ~(alignment - 1);
+
+    // The arena is sized by the caller for the whole init batch; running out
+    // means that estimate needs raising, not a silent fallback.
+    assert(offset + byteSize <= mByteSize && "StagingArena exhausted");
+
+    mOffset = offset + byteSize;
+    return offset;
+}
+
+void StagingArena::StageCopy(ID3D12GraphicsCommandList* cmdList, ID3D12Resource* dest,
+                             UINT64 destOffset, const void* data, UINT64 byteSize)
+{
+    UINT64 offset = Suballocate(byteSize, 4);
+    CopyMemory(mMappedData + offset, data, byteSize);
+    cmdList->CopyBufferRegion(dest, destOffset, mUploadBuffer.Get(), offset, byteSize);
+}
+
+ComPtr<ID3D12Resource> StagingArena::CreateDefaultBuffer(
+    ID3D12GraphicsCommandList* cmdList,
+    const void* initData,
+    UINT64 byteSize)
+{
+    ComPtr<ID3D12Resource> defaultBuffer;
+
+    // Create the actual default buffer resource.
+    ThrowIfFailed(md3dDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+        D3D12_RESOURCE_STATE_COMMON,
+        nullptr,
+        IID_PPV_ARGS(defaultBuffer.GetAddressOf())));
+    GpuMemoryTracker::Instance().Track(defaultBuffer.Get(), GpuMemoryTracker::Category::Geometry);
+
+    // Stage the data into the shared arena and record the copy; the data
+    // reaches the default buffer when the caller's batch executes.
+    UINT64 offset = Suballocate(byteSize, 4);
+    CopyMemory(mMappedData + offset, initData, byteSize);
+
+    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
+        D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST));
+    cmdList->CopyBufferRegion(defaultBuffer.Get(), 0, mUploadBuffer.Get(), offset, byteSize);
+    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
+        D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
+
+    return defaultBuffer;
+}
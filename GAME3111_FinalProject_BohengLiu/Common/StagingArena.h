@@ -0,0 +1,59 @@
+//***************************************************************************************
+// StagingArena.h
+//
+// One large, persistently mapped upload heap that suballocates staging space
+// for initialization copies.  d3dUtil::CreateDefaultBuffer creates a
+// dedicated upload heap per resource and hands it back for the caller to
+// keep alive; batching every init upload through a single arena removes
+// those allocations, and the whole batch retires with one fence wait, after
+// which the arena is destroyed.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class StagingArena
+{
+public:
+
+    StagingArena(ID3D12Device* device, UINT64 byteSize);
+    StagingArena(const StagingArena& rhs) = delete;
+    StagingArena& operator=(const StagingArena& rhs) = delete;
+    ~StagingArena();
+
+    ID3D12Resource* Resource()const { return mUploadBuffer.Get(); }
+
+    ///<summary>
+    /// Copies initData into the arena and records the upload of a new
+    /// default buffer on cmdList; the drop-in replacement for
+    /// d3dUtil::CreateDefaultBuffer without the per-resource upload heap.
+    ///</summary>
+    Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
+        ID3D12GraphicsCommandList* cmdList,
+        const void* initData,
+        UINT64 byteSize);
+
+    ///<summary>
+    /// Reserves aligned staging space for a caller-recorded copy (e.g.
+    /// UpdateSubresources with this arena as the intermediate) and returns
+    /// its byte offset into Resource().
+    ///</summary>
+    UINT64 Suballocate(UINT64 byteSize, UINT64 alignment);
+
+    ///<summary>
+    /// Copies data into the arena and records a copy into destOffset of an
+    /// existing default-heap buffer, which must be in copy-dest state; used
+    /// by the geometry pool's suballocations.
+    ///</summary>
+    void StageCopy(ID3D12GraphicsCommandList* cmdList, ID3D12Resource* dest,
+                   UINT64 destOffset, const void* data, UINT64 byteSize);
+
+private:
+
+    ID3D12Device* md3dDevice = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
+    BYTE* mMappedData = nullptr;
+    UINT64 mByteSize = 0;
+    UINT64 mOffset = 0;
+};
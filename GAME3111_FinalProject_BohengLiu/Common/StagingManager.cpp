@@ -0,0 +1,213 @@
+//***************************************************************************************
+// StagingManager.cpp
+//***************************************************************************************
+
+#include "StagingManager.h"
+
+#include <cassert>
+
+#include "GpuMemoryTracker.h"
+
+using Microsoft::WRL::ComPtr;
+
+StagingManager::StagingManager(ID3D12Device* device, UINT64 ringByteSize)
+    : md3dDevice(device),
+      mRingByteSize(ringByteSize)
+{
+    // Copies run on a dedicated copy queue so they overlap graphics work and
+    // take the DMA path on hardware that has one.
+    D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+    queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+    queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    ThrowIfFailed(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mCopyQueue)));
+
+    // The list opens lazily in EnsureOpen against a recycled allocator; it
+    // only needs to exist closed here.
+    ComPtr<ID3D12CommandAllocator> alloc;
+    ThrowIfFailed(device->CreateCommandAllocator(
+        D3D12_COMMAND_LIST_TYPE_COPY,
+        IID_PPV_ARGS(alloc.GetAddressOf())));
+    ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY,
+        alloc.Get(), nullptr, IID_PPV_ARGS(mCmdList.GetAddressOf())));
+    ThrowIfFailed(mCmdList->Close());
+    mFreeAllocs.push_back(alloc);
+
+    ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence)));
+
+    ThrowIfFailed(device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(ringByteSize),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(mRingBuffer.GetAddressOf())));
+    GpuMemoryTracker::Instance().Track(mRingBuffer.Get(), GpuMemoryTracker::Category::Upload);
+
+    ThrowIfFailed(mRingBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+}
+
+StagingManager::~StagingManager()
+{
+    FlushAndWait();
+
+    if(mRingBuffer != nullptr)
+        mRingBuffer->Unmap(0, nullptr);
+
+    mMappedData = nullptr;
+}
+
+ComPtr<ID3D12Resource> StagingManager::CreateDefaultBuffer(
+    const void* initData,
+    UINT64 byteSize,
+    std::function<void()> onResident)
+{
+    ComPtr<ID3D12Resource> defaultBuffer;
+
+    ThrowIfFailed(md3dDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+        D3D12_RESOURCE_STATE_COMMON,
+        nullptr,
+        IID_PPV_ARGS(defaultBuffer.GetAddressOf())));
+    GpuMemoryTracker::Instance().Track(defaultBuffer.Get(), GpuMemoryTracker::Category::Geometry);
+
+    // Acquire before opening: a full ring may submit the open batch and wait
+    // it out, and the copy below must land in whatever batch follows.
+    UINT64 offset = AcquireStaging(byteSize);
+    EnsureOpen();
+
+    // Buffers promote implicitly from common to copy-dest on the copy queue
+    // and decay back when the batch completes, so no barriers are recorded;
+    // the consuming queue promotes them to read states on first use.
+    CopyMemory(mMappedData + offset, initData, byteSize);
+    mCmdList->CopyBufferRegion(defaultBuffer.Get(), 0, mRingBuffer.Get(), offset, byteSize);
+
+    if(onResident != nullptr)
+        mOpenCallbacks.push_back(std::move(onResident));
+
+    return defaultBuffer;
+}
+
+UINT64 StagingManager::Submit()
+{
+    if(!mOpen)
+        return mFenceValue;
+
+    ThrowIfFailed(mCmdList->Close());
+    ID3D12CommandList* cmdsLists[] = { mCmdList.Get() };
+    mCopyQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+    ++mFenceValue;
+    ThrowIfFailed(mCopyQueue->Signal(mFence.Get(), mFenceValue));
+
+    Batch batch;
+    batch.FenceValue = mFenceValue;
+    batch.ByteCount = mOpenBytes;
+    batch.CmdAlloc = mCurAlloc;
+    batch.Callbacks = std::move(mOpenCallbacks);
+    mInFlight.push(std::move(batch));
+
+    mOpen = false;
+    mOpenBytes = 0;
+    mCurAlloc = nullptr;
+    mOpenCallbacks.clear();
+
+    return mFenceValue;
+}
+
+void StagingManager::Poll()
+{
+    const UINT64 completed = mFence->GetCompletedValue();
+    while(!mInFlight.empty() && mInFlight.front().FenceValue <= completed)
+    {
+        Batch& batch = mInFlight.front();
+
+        mLiveBytes -= batch.ByteCount;
+        mFreeAllocs.push_back(batch.CmdAlloc);
+
+        for(auto& callback : batch.Callbacks)
+            callback();
+
+        mInFlight.pop();
+    }
+}
+
+void StagingManager::FlushAndWait()
+{
+    Submit();
+    WaitForFence(mFenceValue);
+    Poll();
+}
+
+void StagingManager::EnsureOpen()
+{
+    if(mOpen)
+        return;
+
+    // Allocators return to the free list when their batch retires; one per
+    // batch in flight is the working set, created on demand and kept.
+    if(mFreeAllocs.empty())
+    {
+        ComPtr<ID3D12CommandAllocator> alloc;
+        ThrowIfFailed(md3dDevice->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_COPY,
+            IID_PPV_ARGS(alloc.GetAddressOf())));
+        mFreeAllocs.push_back(alloc);
+    }
+
+    mCurAlloc = mFreeAllocs.back();
+    mFreeAllocs.pop_back();
+
+    ThrowIfFailed(mCurAlloc->Reset());
+    ThrowIfFailed(mCmdList->Reset(mCurAlloc.Get(), nullptr));
+    mOpen = true;
+}
+
+UINT64 StagingManager::AcquireStaging(UINT64 byteSize)
+{
+    // The ring is sized by the caller for its largest single upload; a
+    // bigger one means that estimate needs raising, not a silent fallback.
+    assert(byteSize <= mRingByteSize && "StagingManager ring smaller than a single upload");
+
+    for(;;)
+    {
+        UINT64 offset = (mHead + 3) & ~UINT64(3);
+        if(offset + byteSize > mRingByteSize)
+            offset = 0;
+
+        // Bytes this allocation claims measured from the current head, the
+        // alignment pad and any skipped end-of-ring remainder included.
+        UINT64 consumed = (offset >= mHead)
+            ? (offset - mHead) + byteSize
+            : (mRingByteSize - mHead) + offset + byteSize;
+
+        if(mLiveBytes + consumed <= mRingByteSize)
+        {
+            mHead = (offset + byteSize) % mRingByteSize;
+            mLiveBytes += consumed;
+            mOpenBytes += consumed;
+            return offset;
+        }
+
+        // The ring is full of in-flight staging; retire the oldest batch.
+        // When everything live belongs to the batch being recorded, submit
+        // it first so there is something to wait on.
+        if(mInFlight.empty())
+            Submit();
+
+        WaitForFence(mInFlight.front().FenceValue);
+        Poll();
+    }
+}
+
+void StagingManager::WaitForFence(UINT64 fenceValue)
+{
+    if(mFence->GetCompletedValue() < fenceValue)
+    {
+        HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
+        ThrowIfFailed(mFence->SetEventOnCompletion(fenceValue, eventHandle));
+        WaitForSingleObject(eventHandle, INFINITE);
+        CloseHandle(eventHandle);
+    }
+}
@@ -0,0 +1,115 @@
+//***************************************************************************************
+// StagingManager.h
+//
+// Reusable staging backend for default-buffer creation during loading and
+// streaming.  d3dUtil::CreateDefaultBuffer allocates a fresh committed upload
+// heap per buffer, records the copy inline on the caller's graphics list, and
+// parks the heap in a MeshGeometry uploader member until DisposeUploaders;
+// the manager instead suballocates staging space from one persistently mapped
+// ring, records the copies on its own copy queue, and retires batches by
+// fence, firing an optional per-buffer callback once the data is resident.
+// Buffers are created in the common state and rely on implicit promotion and
+// decay, so no barriers cross the copy queue and the graphics queue promotes
+// them to read states on first use (after a GPU-side Wait on Fence()).
+// Callers synchronize externally, like the other upload helpers here.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+#include <functional>
+#include <queue>
+
+class StagingManager
+{
+public:
+
+    StagingManager(ID3D12Device* device, UINT64 ringByteSize = 8 * 1024 * 1024);
+    StagingManager(const StagingManager& rhs) = delete;
+    StagingManager& operator=(const StagingManager& rhs) = delete;
+    ~StagingManager();
+
+    ///<summary>
+    /// Fence the copy queue signals per batch; queues that consume the
+    /// created buffers should Wait on it at the value Submit returned.
+    ///</summary>
+    ID3D12Fence* Fence()const { return mFence.Get(); }
+
+    ///<summary>
+    /// Creates a default-heap buffer, stages initData into the ring, and
+    /// records the copy into the open batch.  The buffer is returned
+    /// immediately; onResident (optional) runs from Poll once the copy has
+    /// retired on the GPU.  No per-call upload heap is allocated and there
+    /// is no uploader for the caller to keep alive.
+    ///</summary>
+    Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
+        const void* initData,
+        UINT64 byteSize,
+        std::function<void()> onResident = nullptr);
+
+    ///<summary>
+    /// Executes the open batch on the copy queue and signals the fence;
+    /// returns the fence value the batch retires on (or the last submitted
+    /// value when nothing is recorded).
+    ///</summary>
+    UINT64 Submit();
+
+    ///<summary>
+    /// Fires the callbacks of batches whose fence has passed and reclaims
+    /// their ring space and command allocators.  Call once per frame.
+    ///</summary>
+    void Poll();
+
+    ///<summary>
+    /// Submits any open batch and blocks until every batch has retired;
+    /// used at shutdown and when a load must complete before continuing.
+    ///</summary>
+    void FlushAndWait();
+
+private:
+
+    struct Batch
+    {
+        UINT64 FenceValue = 0;
+        UINT64 ByteCount = 0;
+        Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdAlloc;
+        std::vector<std::function<void()>> Callbacks;
+    };
+
+    // Opens the command list against a recycled (or new) allocator.
+    void EnsureOpen();
+
+    // Returns a ring offset with byteSize bytes free, submitting and waiting
+    // on in-flight batches when the ring is full.
+    UINT64 AcquireStaging(UINT64 byteSize);
+
+    void WaitForFence(UINT64 fenceValue);
+
+    ID3D12Device* md3dDevice = nullptr;
+
+    Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCopyQueue;
+    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCmdList;
+    Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+    UINT64 mFenceValue = 0;
+
+    // The reusable staging ring: one persistently mapped upload buffer whose
+    // space frees in batch order as fences pass.  mLiveBytes counts every
+    // byte between the oldest in-flight batch and mHead, alignment pads and
+    // end-of-ring remainders included, so the full test is one comparison.
+    Microsoft::WRL::ComPtr<ID3D12Resource> mRingBuffer;
+    BYTE* mMappedData = nullptr;
+    UINT64 mRingByteSize = 0;
+    UINT64 mHead = 0;
+    UINT64 mLiveBytes = 0;
+
+    // Open-batch state; allocators recycle through mFreeAllocs as their
+    // batches retire, so steady-state streaming creates no D3D objects.
+    bool mOpen = false;
+    UINT64 mOpenBytes = 0;
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mCurAlloc;
+    std::vector<std::function<void()>> mOpenCallbacks;
+    std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> mFreeAllocs;
+
+    std::queue<Batch> mInFlight;
+};
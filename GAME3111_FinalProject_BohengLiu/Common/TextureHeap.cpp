@@ -0,0 +1,107 @@
+//***************************************************************************************
+// TextureHeap.cpp
+//***************************************************************************************
+
+#include "TextureHeap.h"
+
+#include <algorithm>
+
+using Microsoft::WRL::ComPtr;
+
+TextureHeap::TextureHeap(ID3D12Device* device, UINT64 byteSize)
+    : md3dDevice(device),
+      mByteSize(byteSize)
+{
+    D3D12_HEAP_DESC heapDesc = {};
+    heapDesc.SizeInBytes = byteSize;
+    heapDesc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+    heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+    heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES;
+
+    ThrowIfFailed(device->CreateHeap(&heapDesc, IID_PPV_ARGS(&mHeap)));
+
+    mFreeRanges.push_back({0, byteSize});
+}
+
+ComPtr<ID3D12Resource> TextureHeap::CreatePlaced(
+    const D3D12_RESOURCE_DESC& desc,
+    D3D12_RESOURCE_STATES initialState)
+{
+    D3D12_RESOURCE_DESC localDesc = desc;
+    const D3D12_RESOURCE_ALLOCATION_INFO info =
+        md3dDevice->GetResourceAllocationInfo(0, 1, &localDesc);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // First fit: carve the allocation from the front of the first range it
+    // fits in, at the alignment the device asked for.
+    for (size_t i = 0; i < mFreeRanges.size(); ++i)
+    {
+        Range& range = mFreeRanges[i];
+
+        const UINT64 offset = (range.Offset + info.Alignment - 1) / info.Alignment * info.Alignment;
+        const UINT64 padding = offset - range.Offset;
+        if (padding + info.SizeInBytes > range.Size)
+            continue;
+
+        ComPtr<ID3D12Resource> resource;
+        ThrowIfFailed(md3dDevice->CreatePlacedResource(
+            mHeap.Get(), offset, &localDesc, initialState, nullptr,
+            IID_PPV_ARGS(&resource)));
+
+        // The alignment padding stays in the free list as its own range so
+        // a later small allocation can still use it.
+        const UINT64 rangeEnd = range.Offset + range.Size;
+        if (padding > 0)
+        {
+            range.Size = padding;
+            mFreeRanges.insert(mFreeRanges.begin() + i + 1,
+                               {offset + info.SizeInBytes, rangeEnd - offset - info.SizeInBytes});
+        }
+        else
+        {
+            range.Offset = offset + info.SizeInBytes;
+            range.Size = rangeEnd - range.Offset;
+        }
+
+        if (mFreeRanges[i].Size == 0)
+            mFreeRanges.erase(mFreeRanges.begin() + i);
+        else if (i + 1 < mFreeRanges.size() && mFreeRanges[i + 1].Size == 0)
+            mFreeRanges.erase(mFreeRanges.begin() + i + 1);
+
+        mPlaced[resource.Get()] = {offset, info.SizeInBytes};
+        return resource;
+    }
+
+    // Full; the caller falls back to a committed resource.
+    return nullptr;
+}
+
+void TextureHeap::Free(ID3D12Resource* resource)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto it = mPlaced.find(resource);
+    if (it == mPlaced.end())
+        return;
+
+    Range freed = it->second;
+    mPlaced.erase(it);
+
+    // Insert in offset order, then merge with whichever neighbors touch.
+    auto pos = std::lower_bound(mFreeRanges.begin(), mFreeRanges.end(), freed,
+        [](const Range& a, const Range& b) { return a.Offset < b.Offset; });
+    pos = mFreeRanges.insert(pos, freed);
+
+    if (pos + 1 != mFreeRanges.end() && pos->Offset + pos->Size == (pos + 1)->Offset)
+    {
+        pos->Size += (pos + 1)->Size;
+        mFreeRanges.erase(pos + 1);
+    }
+
+    if (pos != mFreeRanges.begin() && (pos - 1)->Offset + (pos - 1)->Size == pos->Offset)
+    {
+        (pos - 1)->Size += pos->Size;
+        mFreeRanges.erase(pos);
+    }
+}
@@ -0,0 +1,68 @@
+//***************************************************************************************
+// TextureHeap.h
+//
+// One large ID3D12Heap shared by the streamed textures, handed out as placed
+// resources through a first-fit free list.  Committed resources pay an
+// implicit heap creation per texture and can never reuse each other's
+// memory; placing them all in one upfront heap removes that per-resource
+// overhead and caps the total commitment, and freeing a texture returns its
+// range for the next streaming replacement.  Callers fall back to committed
+// resources when the heap is full.
+//***************************************************************************************
+
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "d3dUtil.h"
+
+class TextureHeap
+{
+public:
+
+    // The heap is sized by the caller for the whole texture set and created
+    // upfront with the textures-only flag, so it never holds buffers or
+    // render targets.
+    TextureHeap(ID3D12Device* device, UINT64 byteSize);
+    TextureHeap(const TextureHeap& rhs) = delete;
+    TextureHeap& operator=(const TextureHeap& rhs) = delete;
+
+    ///<summary>
+    /// Creates the texture as a placed resource in the shared heap, or
+    /// returns null when no free range fits - the caller then falls back to
+    /// a committed resource.  Safe from any thread; the streamer and the
+    /// init stages allocate concurrently.
+    ///</summary>
+    Microsoft::WRL::ComPtr<ID3D12Resource> CreatePlaced(
+        const D3D12_RESOURCE_DESC& desc,
+        D3D12_RESOURCE_STATES initialState);
+
+    ///<summary>
+    /// Returns a placed texture's range to the free list, coalescing with
+    /// adjacent free ranges.  The caller must hold the last reference and
+    /// must know the GPU is done with the texture; resources this heap did
+    /// not place are ignored.
+    ///</summary>
+    void Free(ID3D12Resource* resource);
+
+private:
+
+    struct Range
+    {
+        UINT64 Offset = 0;
+        UINT64 Size = 0;
+    };
+
+    ID3D12Device* md3dDevice = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Heap> mHeap;
+    UINT64 mByteSize = 0;
+
+    std::mutex mMutex;
+
+    // Free ranges sorted by offset so Free can coalesce neighbors, plus the
+    // range each live placed resource occupies.
+    std::vector<Range> mFreeRanges;
+    std::unordered_map<ID3D12Resource*, Range> mPlaced;
+};
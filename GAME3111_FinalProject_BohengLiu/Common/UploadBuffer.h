@@ -1,6 +1,44 @@
 #pragma once
 
+#include <emmintrin.h>
+
 #include "d3dUtil.h"
+#include "GpuMemoryTracker.h"
+
+// Copies above this size into the write-combined upload heap switch to
+// non-temporal streaming stores.  Below it the fence cost outweighs the
+// cache lines a plain memcpy dirties.
+const size_t StreamingCopyThreshold = 4096;
+
+// Copies byteCount bytes into write-combined memory with non-temporal SSE
+// stores: regular stores travel through the cache hierarchy and evict
+// useful lines on the way out, while streaming stores fill write-combining
+// buffers directly.  Only the destination needs 16-byte alignment, so the
+// unaligned head and sub-16-byte tail fall back to memcpy.
+inline void StreamingStoreCopy(BYTE* dst, const BYTE* src, size_t byteCount)
+{
+    size_t head = ((uintptr_t)dst & 15) ? (16 - ((uintptr_t)dst & 15)) : 0;
+    if (head > byteCount)
+        head = byteCount;
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    byteCount -= head;
+
+    // The source is ordinary cacheable memory, so unaligned loads are fine.
+    const size_t chunks = byteCount / 16;
+    for (size_t i = 0; i < chunks; ++i)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src) + i);
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst) + i, v);
+    }
+
+    memcpy(dst + chunks * 16, src + chunks * 16, byteCount - chunks * 16);
+
+    // Streaming stores are weakly ordered; fence so everything the GPU (or
+    // a later fence signal) reads after this call observes the data.
+    _mm_sfence();
+}
 
 template<typename T>
 class UploadBuffer
@@ -29,16 +67,26 @@ public:
             nullptr,
             IID_PPV_ARGS(&mUploadBuffer)));
 
+        GpuMemoryTracker::Instance().Track(mUploadBuffer.Get(), GpuMemoryTracker::Category::Upload);
+
         ThrowIfFailed(mUploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
 
         // We do not need to unmap until we are done with the resource.  However, we must not write to
         // the resource while it is in use by the GPU (so we must use synchronization techniques).
+
+        // CPU-side shadow of the buffer contents.  StageData writes land here
+        // (ordinary cacheable memory) and CopyRange flushes contiguous runs to
+        // the write-combined upload heap in one large memcpy, instead of one
+        // small memcpy per element.
+        mShadowData.resize((size_t)mElementByteSize*elementCount);
     }
 
     UploadBuffer(const UploadBuffer& rhs) = delete;
     UploadBuffer& operator=(const UploadBuffer& rhs) = delete;
     ~UploadBuffer()
     {
+        GpuMemoryTracker::Instance().Untrack(mUploadBuffer.Get());
+
         if(mUploadBuffer != nullptr)
             mUploadBuffer->Unmap(0, nullptr);
 
@@ -52,12 +100,53 @@ public:
 
     void CopyData(int elementIndex, const T& data)
     {
-        memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
+        BYTE* dst = &mMappedData[elementIndex*mElementByteSize];
+        if (sizeof(T) >= StreamingCopyThreshold)
+            StreamingStoreCopy(dst, reinterpret_cast<const BYTE*>(&data), sizeof(T));
+        else
+            memcpy(dst, &data, sizeof(T));
+    }
+
+    // Copies a contiguous run of elements straight from caller memory in
+    // one pass, bypassing the shadow array; large runs take the streaming
+    // store path.  Only valid when elements are packed (no constant buffer
+    // padding), since the source run has no per-element gaps.
+    void CopyData(int firstIndex, const T* data, int count)
+    {
+        assert(mElementByteSize == sizeof(T));
+
+        const size_t byteCount = (size_t)count*sizeof(T);
+        BYTE* dst = &mMappedData[firstIndex*mElementByteSize];
+        if (byteCount >= StreamingCopyThreshold)
+            StreamingStoreCopy(dst, reinterpret_cast<const BYTE*>(data), byteCount);
+        else
+            memcpy(dst, data, byteCount);
+    }
+
+    // Writes an element into the CPU-side shadow array only.  Nothing reaches
+    // the GPU until the containing run is flushed with CopyRange.
+    void StageData(int elementIndex, const T& data)
+    {
+        memcpy(&mShadowData[elementIndex*mElementByteSize], &data, sizeof(T));
+    }
+
+    // Flushes spanCount staged elements starting at firstIndex to the upload
+    // heap as one contiguous copy; large runs take the streaming store path.
+    void CopyRange(int firstIndex, int spanCount)
+    {
+        const size_t byteCount = (size_t)spanCount*mElementByteSize;
+        BYTE* dst = &mMappedData[firstIndex*mElementByteSize];
+        const BYTE* src = &mShadowData[firstIndex*mElementByteSize];
+        if (byteCount >= StreamingCopyThreshold)
+            StreamingStoreCopy(dst, src, byteCount);
+        else
+            memcpy(dst, src, byteCount);
     }
 
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
+    std::vector<BYTE> mShadowData;
 
     UINT mElementByteSize = 0;
     bool mIsConstantBuffer = false;
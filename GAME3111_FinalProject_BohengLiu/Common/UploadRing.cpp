@@ -0,0 +1,84 @@
+//***************************************************************************************
+// UploadRing.cpp
+//***************************************************************************************
+
+#include "UploadRing.h"
+
+#include <cassert>
+
+#include "GpuMemoryTracker.h"
+
+using Microsoft::WRL::ComPtr;
+
+UploadRing::UploadRing(ID3D12Device* device, UINT64 pageSize)
+    : md3dDevice(device),
+      mPageSize(pageSize)
+{
+    AddPage();
+}
+
+UploadRing::~UploadRing()
+{
+    for(auto& page : mPages)
+    {
+        if(page.Buffer != nullptr)
+            page.Buffer->Unmap(0, nullptr);
+    }
+}
+
+UploadRing::Page& UploadRing::AddPage()
+{
+    Page page;
+
+    ThrowIfFailed(md3dDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(mPageSize),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(page.Buffer.GetAddressOf())));
+    GpuMemoryTracker::Instance().Track(page.Buffer.Get(), GpuMemoryTracker::Category::Upload);
+
+    ThrowIfFailed(page.Buffer->Map(0, nullptr, reinterpret_cast<void**>(&page.MappedData)));
+
+    mPages.push_back(page);
+    return mPages.back();
+}
+
+void UploadRing::Reset()
+{
+    mCurPage = 0;
+    mCurOffset = 0;
+}
+
+BYTE* UploadRing::Allocate(UINT64 byteSize, UINT64 alignment, D3D12_GPU_VIRTUAL_ADDRESS& gpuAddress)
+{
+    assert(byteSize <= mPageSize && "UploadRing allocation larger than a page");
+
+    UINT64 offset = (mCurOffset + alignment - 1) & ~(alignment - 1);
+
+    // Current page exhausted: move to the next, chaining a fresh page on
+    // first use.  Pages persist across frames, so steady-state allocation
+    // never touches the device.
+    if(offset + byteSize > mPageSize)
+    {
+        ++mCurPage;
+        if(mCurPage == mPages.size())
+            AddPage();
+        offset = 0;
+    }
+
+    Page& page = mPages[mCurPage];
+    mCurOffset = offset + byteSize;
+
+    gpuAddress = page.Buffer->GetGPUVirtualAddress() + offset;
+    return page.MappedData + offset;
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS UploadRing::Push(const void* data, UINT64 byteSize, UINT64 alignment)
+{
+    D3D12_GPU_VIRTUAL_ADDRESS gpuAddress;
+    BYTE* dst = Allocate(byteSize, alignment, gpuAddress);
+    CopyMemory(dst, data, byteSize);
+    return gpuAddress;
+}
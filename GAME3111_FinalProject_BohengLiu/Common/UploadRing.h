@@ -0,0 +1,60 @@
+//***************************************************************************************
+// UploadRing.h
+//
+// Per-frame linear allocator over persistently mapped upload pages.  Each
+// FrameResource owns one; the Update* functions suballocate their transient
+// constant and instance data from it every frame instead of writing into
+// fixed-capacity UploadBuffer arrays, so items and materials can come and go
+// at runtime without rebuilding FrameResources behind a FlushCommandQueue.
+// A frame that outgrows its pages chains a fresh one on, so capacity follows
+// demand; Reset rewinds to the first page once the frame's fence has passed.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class UploadRing
+{
+public:
+
+    explicit UploadRing(ID3D12Device* device, UINT64 pageSize = 512 * 1024);
+    UploadRing(const UploadRing& rhs) = delete;
+    UploadRing& operator=(const UploadRing& rhs) = delete;
+    ~UploadRing();
+
+    ///<summary>
+    /// Rewinds the allocator to the start of its first page.  Call once per
+    /// frame, after the owning FrameResource's fence wait.
+    ///</summary>
+    void Reset();
+
+    ///<summary>
+    /// Reserves byteSize bytes at the given alignment and returns the CPU
+    /// write pointer; gpuAddress receives the matching GPU virtual address.
+    ///</summary>
+    BYTE* Allocate(UINT64 byteSize, UINT64 alignment, D3D12_GPU_VIRTUAL_ADDRESS& gpuAddress);
+
+    ///<summary>
+    /// Copies data into the ring and returns its GPU virtual address.  The
+    /// default alignment satisfies constant buffer placement rules.
+    ///</summary>
+    D3D12_GPU_VIRTUAL_ADDRESS Push(const void* data, UINT64 byteSize, UINT64 alignment = 256);
+
+private:
+
+    struct Page
+    {
+        Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+        BYTE* MappedData = nullptr;
+    };
+
+    Page& AddPage();
+
+    ID3D12Device* md3dDevice = nullptr;
+    UINT64 mPageSize = 0;
+
+    std::vector<Page> mPages;
+    size_t mCurPage = 0;
+    UINT64 mCurOffset = 0;
+};
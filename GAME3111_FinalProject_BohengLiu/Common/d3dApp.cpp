@@ -3,6 +3,10 @@
 //***************************************************************************************
 
 #include "d3dApp.h"
+#include "CpuProfiler.h"
+#include "DeferredDeleter.h"
+#include "FlightRecorder.h"
+#include "GpuMemoryTracker.h"
 #include <WindowsX.h>
 
 using Microsoft::WRL::ComPtr;
@@ -35,6 +39,9 @@ D3DApp::~D3DApp()
 {
 	if(md3dDevice != nullptr)
 		FlushCommandQueue();
+
+	if(mFrameLatencyWaitable != nullptr)
+		CloseHandle(mFrameLatencyWaitable);
 }
 
 HINSTANCE D3DApp::AppInst()const
@@ -63,8 +70,9 @@ void D3DApp::Set4xMsaaState(bool value)
     {
         m4xMsaaState = value;
 
-        //! Recreate the swapchain and buffers with new multisample settings.
-        CreateSwapChain();
+        // The swap chain stays single-sample; multisampled color lives in an
+        // offscreen target the app resolves from, so only the depth buffer
+        // (and any app render targets) need recreating here.
         OnResize();
     }
 }
@@ -72,36 +80,111 @@ void D3DApp::Set4xMsaaState(bool value)
 int D3DApp::Run()
 {
 	MSG msg = {0};
- 
+
 	mTimer.Reset();
 
-	while(msg.message != WM_QUIT)
+	// Frames are produced on a dedicated render thread; this thread only
+	// pumps messages, so window drags, menu interaction, and slow handlers
+	// no longer stall rendering.
+	mQuitRendering = false;
+	mRenderThread = std::thread(&D3DApp::RenderLoop, this);
+
+	while(GetMessage(&msg, 0, 0, 0) > 0)
 	{
-		// If there are Window messages then process them.
-		if(PeekMessage( &msg, 0, 0, 0, PM_REMOVE ))
+		TranslateMessage( &msg );
+		DispatchMessage( &msg );
+	}
+
+	mQuitRendering = true;
+	if(mRenderThread.joinable())
+		mRenderThread.join();
+
+	return (int)msg.wParam;
+}
+
+void D3DApp::RenderLoop()
+{
+	while(!mQuitRendering)
+	{
+		// Apply the most recent window work the message handlers queued,
+		// then replay mouse input, all on this thread so the overrides
+		// never race the frame.
+		if(mMsaaTogglePending.exchange(false))
+			Set4xMsaaState(!m4xMsaaState);
+
+		if(mResizePending.exchange(false))
 		{
-            TranslateMessage( &msg );
-            DispatchMessage( &msg );
+			mClientWidth  = mPendingClientWidth;
+			mClientHeight = mPendingClientHeight;
+			OnResize();
+		}
+
+		PumpMouseEvents();
+
+		mTimer.Tick();
+
+		if( !mAppPaused )
+		{
+			// Block until the presenter has a slot for a new frame.  Pacing
+			// the CPU off the swap chain here, before any frame work starts,
+			// means input is sampled as late as possible - the main
+			// input-to-photon win of the waitable chain.
+			if(mFrameLatencyWaitable != nullptr)
+				WaitForSingleObjectEx(mFrameLatencyWaitable, 1000, TRUE);
+
+			CalculateFrameStats();
+			Update(mTimer);
+			Draw(mTimer);
+			CpuProfiler::Instance().EndFrame();
+
+			// Snapshot the frame into the hitch ring; a frame over the
+			// threshold dumps the ring to the log from here, where the
+			// per-stage totals above are freshly folded.
+			FlightRecorder::Instance().EndFrame(mTimer.DeltaTime() * 1000.0);
+
+			// Reclaim whatever deferred releases the GPU has passed.
+			DeferredDeleter::Instance().Collect(mFence->GetCompletedValue());
 		}
-		// Otherwise, do animation/game stuff.
 		else
-        {	
-			mTimer.Tick();
+		{
+			Sleep(100);
+		}
+	}
+}
 
-			if( !mAppPaused )
-			{
-				CalculateFrameStats();
-				Update(mTimer);	
-                Draw(mTimer);
-			}
-			else
-			{
-				Sleep(100);
-			}
-        }
-    }
+void D3DApp::PumpMouseEvents()
+{
+	std::vector<MouseEvent> events;
+	{
+		std::lock_guard<std::mutex> lock(mMouseEventMutex);
+		events.swap(mMouseEvents);
+	}
 
-	return (int)msg.wParam;
+	for(const MouseEvent& e : events)
+	{
+		switch(e.Msg)
+		{
+		case WM_LBUTTONDOWN:
+		case WM_MBUTTONDOWN:
+		case WM_RBUTTONDOWN:
+			OnMouseDown(e.BtnState, e.X, e.Y);
+			break;
+		case WM_LBUTTONUP:
+		case WM_MBUTTONUP:
+		case WM_RBUTTONUP:
+			OnMouseUp(e.BtnState, e.X, e.Y);
+			break;
+		case WM_MOUSEMOVE:
+			OnMouseMove(e.BtnState, e.X, e.Y);
+			break;
+		}
+	}
+}
+
+void D3DApp::ConsumeRawMouseDelta(int& dx, int& dy)
+{
+	dx = (int)mRawMouseDx.exchange(0);
+	dy = (int)mRawMouseDy.exchange(0);
 }
 
 bool D3DApp::Initialize()
@@ -149,17 +232,22 @@ void D3DApp::OnResize()
 
     ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
 
-	//! Release the previous resources we will be recreating.
+	//! Release the previous resources we will be recreating.  The swap
+	//! chain buffers must go immediately - ResizeBuffers fails while any
+	//! reference to them is live, which is what forces the drain above.
+	//! The depth buffer has no such constraint, so it rides the deferred
+	//! queue like any other release.
 	for (int i = 0; i < SwapChainBufferCount; ++i)
 		mSwapChainBuffer[i].Reset();
+    DeferredDeleter::Instance().Defer(mDepthStencilBuffer, mCurrentFence);
     mDepthStencilBuffer.Reset();
 	
 	//! Resize the swap chain.
     ThrowIfFailed(mSwapChain->ResizeBuffers(
-		SwapChainBufferCount, 
-		mClientWidth, mClientHeight, 
-		mBackBufferFormat, 
-		DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH));
+		SwapChainBufferCount,
+		mClientWidth, mClientHeight,
+		mBackBufferFormat,
+		mSwapChainFlags));
 
 	mCurrBackBuffer = 0;
  
@@ -202,11 +290,12 @@ void D3DApp::OnResize()
 		D3D12_RESOURCE_STATE_COMMON,
         &optClear,
         IID_PPV_ARGS(mDepthStencilBuffer.GetAddressOf())));
+    GpuMemoryTracker::Instance().Track(mDepthStencilBuffer.Get(), GpuMemoryTracker::Category::RenderTargets);
 
     //! Create descriptor to mip level 0 of entire resource using the format of the resource.
 	D3D12_DEPTH_STENCIL_VIEW_DESC dsvDesc;
 	dsvDesc.Flags = D3D12_DSV_FLAG_NONE;
-	dsvDesc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+	dsvDesc.ViewDimension = m4xMsaaState ? D3D12_DSV_DIMENSION_TEXTURE2DMS : D3D12_DSV_DIMENSION_TEXTURE2D;
 	dsvDesc.Format = mDepthStencilFormat;
 	dsvDesc.Texture2D.MipSlice = 0;
     md3dDevice->CreateDepthStencilView(mDepthStencilBuffer.Get(), &dsvDesc, DepthStencilView());
@@ -254,12 +343,20 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 		}
 		return 0;
 
-	//! WM_SIZE is sent when the user resizes the window.  
+	//! WM_SIZE is sent when the user resizes the window.
 	case WM_SIZE:
-		//! Save the new client area dimensions.
-		mClientWidth  = LOWORD(lParam);
-		mClientHeight = HIWORD(lParam);
-		if( md3dDevice )
+		//! Save the new client area dimensions.  Once the device exists the
+		//! resize itself is handed to the render thread, which owns all
+		//! device work.
+		mPendingClientWidth  = LOWORD(lParam);
+		mPendingClientHeight = HIWORD(lParam);
+		if( md3dDevice == nullptr )
+		{
+			// No render thread yet; take the size directly.
+			mClientWidth  = mPendingClientWidth;
+			mClientHeight = mPendingClientHeight;
+		}
+		else
 		{
 			if( wParam == SIZE_MINIMIZED )
 			{
@@ -272,7 +369,7 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 				mAppPaused = false;
 				mMinimized = false;
 				mMaximized = true;
-				OnResize();
+				mResizePending = true;
 			}
 			else if( wParam == SIZE_RESTORED )
 			{
@@ -282,7 +379,7 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 				{
 					mAppPaused = false;
 					mMinimized = false;
-					OnResize();
+					mResizePending = true;
 				}
 
 				// Restoring from maximized state?
@@ -290,7 +387,7 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 				{
 					mAppPaused = false;
 					mMaximized = false;
-					OnResize();
+					mResizePending = true;
 				}
 				else if( mResizing )
 				{
@@ -305,7 +402,7 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 				}
 				else // API call such as SetWindowPos or mSwapChain->SetFullscreenState.
 				{
-					OnResize();
+					mResizePending = true;
 				}
 			}
 		}
@@ -324,7 +421,7 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 		mAppPaused = false;
 		mResizing  = false;
 		mTimer.Start();
-		OnResize();
+		mResizePending = true;
 		return 0;
  
 	//! WM_DESTROY is sent when the window is being destroyed.
@@ -347,23 +444,42 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 	case WM_LBUTTONDOWN:
 	case WM_MBUTTONDOWN:
 	case WM_RBUTTONDOWN:
-		OnMouseDown(wParam, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
-		return 0;
 	case WM_LBUTTONUP:
 	case WM_MBUTTONUP:
 	case WM_RBUTTONUP:
-		OnMouseUp(wParam, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
-		return 0;
 	case WM_MOUSEMOVE:
-		OnMouseMove(wParam, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam));
+	{
+		// Record the event; the render thread replays it through the
+		// OnMouse* overrides at the start of the next frame.
+		std::lock_guard<std::mutex> lock(mMouseEventMutex);
+		mMouseEvents.push_back({ msg, wParam, GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam) });
 		return 0;
+	}
+
+	case WM_INPUT:
+	{
+		// Raw mouse motion.  The deltas accumulate lock-free and the render
+		// thread drains them once per frame (ConsumeRawMouseDelta), so look
+		// input is sampled at frame rate rather than message-pump rate.
+		RAWINPUT raw;
+		UINT size = sizeof(raw);
+		if(GetRawInputData((HRAWINPUT)lParam, RID_INPUT, &raw, &size, sizeof(RAWINPUTHEADER)) != (UINT)-1 &&
+		   raw.header.dwType == RIM_TYPEMOUSE &&
+		   (raw.data.mouse.usFlags & MOUSE_MOVE_ABSOLUTE) == 0)
+		{
+			mRawMouseDx += raw.data.mouse.lLastX;
+			mRawMouseDy += raw.data.mouse.lLastY;
+		}
+		// Raw input still wants the default cleanup to run.
+		return DefWindowProc(hwnd, msg, wParam, lParam);
+	}
     case WM_KEYUP:
         if(wParam == VK_ESCAPE)
         {
             PostQuitMessage(0);
         }
         else if((int)wParam == VK_F2)
-            Set4xMsaaState(!m4xMsaaState);
+            mMsaaTogglePending = true; // swap chain work runs on the render thread
 
         return 0;
 	}
@@ -408,6 +524,16 @@ bool D3DApp::InitMainWindow()
 	ShowWindow(mhMainWnd, SW_SHOW);
 	UpdateWindow(mhMainWnd);
 
+	// Register for raw mouse input.  WM_MOUSEMOVE coalesces motion to the
+	// message pump's cadence; the WM_INPUT stream delivers every device
+	// delta.  Failure is non-fatal - the coalesced path stays as fallback.
+	RAWINPUTDEVICE rid;
+	rid.usUsagePage = 0x01; // HID_USAGE_PAGE_GENERIC
+	rid.usUsage     = 0x02; // HID_USAGE_GENERIC_MOUSE
+	rid.dwFlags     = 0;
+	rid.hwndTarget  = mhMainWnd;
+	mRawMouseActive = RegisterRawInputDevices(&rid, 1, sizeof(rid)) != FALSE;
+
 	return true;
 }
 
@@ -485,7 +611,18 @@ bool D3DApp::InitDirect3D()
 
     m4xMsaaQuality = msQualityLevels.NumQualityLevels;
 	assert(m4xMsaaQuality > 0 && "Unexpected MSAA quality level.");
-	
+
+	// Hand the memory tracker the adapter the device actually landed on
+	// (found by LUID, since creation above passes the default adapter), so
+	// it can poll the OS video memory budget every frame.  Runtimes without
+	// IDXGIAdapter3 just leave the budget readout disabled.
+	ComPtr<IDXGIAdapter3> memoryAdapter;
+	if(SUCCEEDED(mdxgiFactory->EnumAdapterByLuid(md3dDevice->GetAdapterLuid(),
+		IID_PPV_ARGS(&memoryAdapter))))
+	{
+		GpuMemoryTracker::Instance().SetAdapter(memoryAdapter.Get());
+	}
+
 #ifdef _DEBUG
     LogAdapters();
 #endif
@@ -527,29 +664,63 @@ void D3DApp::CreateSwapChain()
 {
     //! Release the previous swapchain we will be recreating.
     mSwapChain.Reset();
+    if(mFrameLatencyWaitable != nullptr)
+    {
+        CloseHandle(mFrameLatencyWaitable);
+        mFrameLatencyWaitable = nullptr;
+    }
+
+    // Tearing support (uncapped presents, variable refresh displays) is a
+    // factory capability we query up front.
+    mTearingSupported = false;
+    ComPtr<IDXGIFactory5> factory5;
+    if(SUCCEEDED(mdxgiFactory.As(&factory5)))
+    {
+        BOOL allowTearing = FALSE;
+        if(SUCCEEDED(factory5->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING,
+            &allowTearing, sizeof(allowTearing))))
+            mTearingSupported = allowTearing == TRUE;
+    }
 
-    DXGI_SWAP_CHAIN_DESC sd;
-    sd.BufferDesc.Width = mClientWidth;
-    sd.BufferDesc.Height = mClientHeight;
-    sd.BufferDesc.RefreshRate.Numerator = 60;
-    sd.BufferDesc.RefreshRate.Denominator = 1;
-    sd.BufferDesc.Format = mBackBufferFormat;
-    sd.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
-    sd.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
-    sd.SampleDesc.Count = m4xMsaaState ? 4 : 1;
-    sd.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
+    // ResizeBuffers must repeat the creation flags, so keep them around.
+    mSwapChainFlags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+    if(mTearingSupported)
+        mSwapChainFlags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+
+    DXGI_SWAP_CHAIN_DESC1 sd;
+    sd.Width = mClientWidth;
+    sd.Height = mClientHeight;
+    sd.Format = mBackBufferFormat;
+    sd.Stereo = FALSE;
+    // Flip-model swap chains are always single-sample; with MSAA on, the
+    // app renders into a multisampled offscreen target and resolves into
+    // the back buffer.
+    sd.SampleDesc.Count = 1;
+    sd.SampleDesc.Quality = 0;
     sd.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
     sd.BufferCount = SwapChainBufferCount;
-    sd.OutputWindow = mhMainWnd;
-    sd.Windowed = true;
+    sd.Scaling = DXGI_SCALING_STRETCH;
 	sd.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-    sd.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+    sd.AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED;
+    sd.Flags = mSwapChainFlags;
 
 	// Note: Swap chain uses queue to perform flush.
-    ThrowIfFailed(mdxgiFactory->CreateSwapChain(
+    ComPtr<IDXGISwapChain1> swapChain1;
+    ThrowIfFailed(mdxgiFactory->CreateSwapChainForHwnd(
 		mCommandQueue.Get(),
-		&sd, 
-		mSwapChain.GetAddressOf()));
+		mhMainWnd,
+		&sd,
+		nullptr, nullptr,
+		swapChain1.GetAddressOf()));
+    ThrowIfFailed(swapChain1.As(&mSwapChain));
+
+    // Two queued presents gives the pipeline one frame of headroom without
+    // letting the CPU run unboundedly ahead of the presenter; the render
+    // loop blocks on the waitable before starting each frame.
+    ComPtr<IDXGISwapChain2> swapChain2;
+    ThrowIfFailed(swapChain1.As(&swapChain2));
+    ThrowIfFailed(swapChain2->SetMaximumFrameLatency(2));
+    mFrameLatencyWaitable = swapChain2->GetFrameLatencyWaitableObject();
 }
 
 void D3DApp::FlushCommandQueue()
@@ -574,6 +745,9 @@ void D3DApp::FlushCommandQueue()
 		WaitForSingleObject(eventHandle, INFINITE);
         CloseHandle(eventHandle);
 	}
+
+	// The queue is drained, so everything deferred so far is reclaimable.
+	DeferredDeleter::Instance().Collect(mCurrentFence);
 }
 
 
@@ -607,21 +781,36 @@ void D3DApp::CalculateFrameStats()
 
 	frameCnt++;
 
+	// Refresh the OS video memory numbers every frame so the warning state
+	// reacts within a frame of a streaming burst, not a second later.
+	GpuMemoryTracker& gpuMem = GpuMemoryTracker::Instance();
+	gpuMem.QueryBudget();
+
 	// Compute averages over one second period.
 	if( (mTimer.TotalTime() - timeElapsed) >= 1.0f )
 	{
 		float fps = (float)frameCnt; // fps = frameCnt / 1
 		float mspf = 1000.0f / fps;
 
-        wstring fpsStr = to_wstring(fps);
-        wstring mspfStr = to_wstring(mspf);
+        // Format into a fixed stack buffer; the frame loop should not hit
+        // the global heap just to refresh the caption.
+        wchar_t windowText[256];
+        swprintf_s(windowText, L"%s    fps: %f   mspf: %f   vram: %llu/%llu MB%s",
+            mMainWndCaption.c_str(), fps, mspf,
+            gpuMem.UsageBytes() >> 20, gpuMem.BudgetBytes() >> 20,
+            gpuMem.NearBudget() ? L"  ** NEAR BUDGET **" : L"");
+
+        SetWindowText(mhMainWnd, windowText);
+
+		// Dump the hierarchical CPU timings gathered by PROFILE_SCOPE to
+		// the debugger output.  The min/avg/max roll until the app resets
+		// them (e.g. after dumping a CSV snapshot).
+		OutputDebugStringA(CpuProfiler::Instance().BuildReport().c_str());
 
-        wstring windowText = mMainWndCaption +
-            L"    fps: " + fpsStr +
-            L"   mspf: " + mspfStr;
+		// And the per-category VRAM accounting next to it, so a paging
+		// cliff can be traced to the resources that filled the budget.
+		OutputDebugStringA(gpuMem.BuildReport().c_str());
 
-        SetWindowText(mhMainWnd, windowText.c_str());
-		
 		// Reset for next average.
 		frameCnt = 0;
 		timeElapsed += 1.0f;
@@ -9,6 +9,9 @@
 
 #include "d3dUtil.h"
 #include "GameTimer.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 // Link necessary d3d12 libraries.
 #pragma comment(lib,"d3dcompiler.lib")
@@ -66,6 +69,19 @@ protected:
 
 	void CalculateFrameStats();
 
+	// Body of the render thread: applies pending window work, then runs the
+	// usual Update/Draw frame.  The window thread only pumps messages.
+	void RenderLoop();
+
+	// Replays mouse events recorded by the window thread so the OnMouse*
+	// overrides still run on the render thread.
+	void PumpMouseEvents();
+
+	// Drains the raw mouse delta accumulated since the last call.  Meant to
+	// be called once per frame, as late as possible before the view matrix
+	// rebuild, so look input carries the freshest motion.
+	void ConsumeRawMouseDelta(int& dx, int& dy);
+
     void LogAdapters();
     void LogAdapterOutputs(IDXGIAdapter* adapter);
     void LogOutputDisplayModes(IDXGIOutput* output, DXGI_FORMAT format);
@@ -76,21 +92,63 @@ protected:
 
     HINSTANCE mhAppInst = nullptr; // application instance handle
     HWND      mhMainWnd = nullptr; // main window handle
-	bool      mAppPaused = false;  // is the application paused?
+	std::atomic<bool> mAppPaused{false};  // is the application paused?
 	bool      mMinimized = false;  // is the application minimized?
 	bool      mMaximized = false;  // is the application maximized?
 	bool      mResizing = false;   // are the resize bars being dragged?
     bool      mFullscreenState = false;// fullscreen enabled
 
+	// Rendering runs on its own thread so window drags and slow message
+	// handlers never stall frame production.  The message handlers hand
+	// device work to the render thread through these instead of acting
+	// directly; only the pending size is touched by both threads.
+	std::thread mRenderThread;
+	std::atomic<bool> mQuitRendering{false};
+	std::atomic<bool> mResizePending{false};
+	std::atomic<bool> mMsaaTogglePending{false};
+	std::atomic<int> mPendingClientWidth{800};
+	std::atomic<int> mPendingClientHeight{600};
+
+	// Mouse events recorded by the window thread and replayed on the render
+	// thread at the start of each frame.
+	struct MouseEvent
+	{
+		UINT Msg;
+		WPARAM BtnState;
+		int X;
+		int Y;
+	};
+	std::mutex mMouseEventMutex;
+	std::vector<MouseEvent> mMouseEvents;
+
+	// Raw mouse deltas from WM_INPUT, accumulated lock-free on the window
+	// thread and drained once per frame on the render thread.  Unlike
+	// WM_MOUSEMOVE, the raw stream is neither coalesced by Windows nor
+	// quantized to message-pump timing.  When registration fails the
+	// OnMouseMove path keeps working as the fallback.
+	std::atomic<long> mRawMouseDx{0};
+	std::atomic<long> mRawMouseDy{0};
+	bool mRawMouseActive = false;
+
 	// Set true to use 4X MSAA.  The default is false.
     bool      m4xMsaaState = false;    // 4X MSAA enabled
     UINT      m4xMsaaQuality = 0;      // quality level of 4X MSAA
 
-	// Used to keep track of the �delta-time?and game time.
+	// Used to keep track of the �delta-time?and game time.
 	GameTimer mTimer;
 	
     Microsoft::WRL::ComPtr<IDXGIFactory4> mdxgiFactory;
     Microsoft::WRL::ComPtr<IDXGISwapChain> mSwapChain;
+
+	// Waitable flip-model presentation.  The render loop blocks on the
+	// latency waitable before starting a frame so the CPU paces itself to
+	// the presenter instead of free-running; when the factory supports
+	// tearing, Present passes DXGI_PRESENT_ALLOW_TEARING so uncapped runs
+	// are not throttled to vblank.  ResizeBuffers must repeat the creation
+	// flags, hence mSwapChainFlags.
+	HANDLE mFrameLatencyWaitable = nullptr;
+	bool mTearingSupported = false;
+	UINT mSwapChainFlags = 0;
     Microsoft::WRL::ComPtr<ID3D12Device> md3dDevice;
 
     Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
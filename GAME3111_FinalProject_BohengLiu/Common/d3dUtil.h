@@ -2,7 +2,7 @@
 
 #include <windows.h>
 #include <wrl.h>
-#include <dxgi1_4.h>
+#include <dxgi1_5.h>
 #include <d3d12.h>
 #include <D3Dcompiler.h>
 #include <DirectXMath.h>
@@ -21,6 +21,7 @@
 #include <cassert>
 #include "d3dx12.h"
 #include "DDSTextureLoader.h"
+#include "DeferredDeleter.h"
 #include "MathHelper.h"
 
 extern const int gNumFrameResources;
@@ -120,6 +121,9 @@ public:
 		const D3D_SHADER_MACRO* defines,
 		const std::string& entrypoint,
 		const std::string& target);
+
+	// FNV-1a 64-bit, used to key the compiled shader and PSO disk caches.
+	static UINT64 HashBytes(const void* data, size_t byteCount, UINT64 hash = 14695981039346656037ULL);
 };
 
 class DxException
@@ -184,6 +188,11 @@ struct MeshGeometry
 	UINT ColorByteStride = 0;
 	UINT ColorBufferByteSize = 0;
 
+	// Byte offsets of this mesh's runs when the buffers are suballocated
+	// from a shared geometry pool; zero for meshes owning whole resources.
+	UINT VertexBufferOffset = 0;
+	UINT IndexBufferOffset = 0;
+
 
 	// A MeshGeometry may store multiple geometries in one vertex/index buffer.
 	// Use this container to define the Submesh geometries so we can draw
@@ -195,7 +204,7 @@ struct MeshGeometry
 
 	{
 		D3D12_VERTEX_BUFFER_VIEW vbv;
-		vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress();
+		vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress() + VertexBufferOffset;
 		vbv.StrideInBytes = VertexByteStride;
 		vbv.SizeInBytes = VertexBufferByteSize;
 
@@ -206,7 +215,7 @@ struct MeshGeometry
 
 	{
 		D3D12_INDEX_BUFFER_VIEW ibv;
-		ibv.BufferLocation = IndexBufferGPU->GetGPUVirtualAddress();
+		ibv.BufferLocation = IndexBufferGPU->GetGPUVirtualAddress() + IndexBufferOffset;
 		ibv.Format = IndexFormat;
 		ibv.SizeInBytes = IndexBufferByteSize;
 
@@ -232,6 +241,17 @@ struct MeshGeometry
 		IndexBufferUploader = nullptr;
 		ColorBufferUploader = nullptr;
 	}
+
+	// Same, but without requiring a queue drain first: the references ride
+	// the deferred-deletion queue until the given value on the app's main
+	// queue fence - the one covering the copies that read them - has
+	// passed on the GPU.
+	void DisposeUploaders(UINT64 fenceValue)
+	{
+		DeferredDeleter::Instance().Defer(std::move(VertexBufferUploader), fenceValue);
+		DeferredDeleter::Instance().Defer(std::move(IndexBufferUploader), fenceValue);
+		DeferredDeleter::Instance().Defer(std::move(ColorBufferUploader), fenceValue);
+	}
 };
 
 
@@ -258,6 +278,16 @@ struct MaterialConstants
 
 	// Used in texture mapping.
 	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4x4();
+
+	// Index into the diffuse map array in the shader; lets the SRV heap be
+	// bound once instead of one descriptor table bind per draw.
+	UINT DiffuseMapIndex = 0;
+
+	// Slice within the packed castle Texture2DArray for materials whose
+	// diffuse maps share one array resource; ignored by the rest.
+	UINT DiffuseArraySlice = 0;
+	UINT MaterialPad1;
+	UINT MaterialPad2;
 };
 
 // Simple struct to represent a material for our demos.  A production 3D engine
@@ -273,6 +303,10 @@ struct Material
 	// Index into SRV heap for diffuse texture.
 	int DiffuseSrvHeapIndex = -1;
 
+	// Array slice when the diffuse map is packed into a Texture2DArray with
+	// other same-format maps; zero for materials with their own texture.
+	int DiffuseArraySlice = 0;
+
 	// Index into SRV heap for normal texture.
 	int NormalSrvHeapIndex = -1;
 
@@ -296,6 +330,10 @@ struct Texture
 
 	std::wstring Filename;
 
+	// When non-empty the texture is a Texture2DArray packed from these
+	// same-format, same-size files (one slice each) and Filename is unused.
+	std::vector<std::wstring> SliceFilenames;
+
 	Microsoft::WRL::ComPtr<ID3D12Resource> Resource = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap = nullptr;
 };
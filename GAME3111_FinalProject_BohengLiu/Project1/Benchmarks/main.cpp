@@ -0,0 +1,175 @@
+//***************************************************************************************
+// main.cpp : console microbenchmarks for the math and geometry kernels.
+//
+// Times the CPU kernels the app leans on every frame - the Waves solver at
+// several grid sizes and GeometryGenerator's geosphere path (which exercises
+// Subdivide) - standalone, with warmup and repetition, so a change to them
+// can be measured without eyeballing FPS in the full app.
+//
+// Each benchmark reports the best of its repetitions (least scheduler
+// noise).  Results go to microbench.csv; if microbench_baseline.csv exists
+// (a renamed previous run), the output includes the delta against it.
+// Build Release x64 - Debug numbers are meaningless.
+//***************************************************************************************
+
+#include <windows.h>
+#include <cstdio>
+#include <cfloat>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "../../Common/GeometryGenerator.h"
+#include "../../Common/MathHelper.h"
+#include "../Project1/Waves.h"
+
+namespace
+{
+    double gSecondsPerCount = 0.0;
+
+    double Now()
+    {
+        __int64 counts;
+        QueryPerformanceCounter((LARGE_INTEGER*)&counts);
+        return counts * gSecondsPerCount;
+    }
+
+    // Best-of-repetitions wall time of fn(), in milliseconds.
+    template<typename F>
+    double TimeBest(int repetitions, F fn)
+    {
+        double best = DBL_MAX;
+        for(int r = 0; r < repetitions; ++r)
+        {
+            double start = Now();
+            fn();
+            double ms = (Now() - start) * 1000.0;
+            if(ms < best)
+                best = ms;
+        }
+        return best;
+    }
+
+    std::map<std::string, double> gResults;
+    std::map<std::string, double> gBaseline;
+
+    void Report(const std::string& name, double ms, const char* extra)
+    {
+        gResults[name] = ms;
+
+        auto base = gBaseline.find(name);
+        if(base != gBaseline.end() && base->second > 0.0)
+        {
+            printf("%-34s %10.3f ms  %-24s %+7.1f%% vs baseline\n",
+                name.c_str(), ms, extra, (ms / base->second - 1.0) * 100.0);
+        }
+        else
+        {
+            printf("%-34s %10.3f ms  %s\n", name.c_str(), ms, extra);
+        }
+    }
+
+    void LoadBaseline()
+    {
+        std::ifstream fin("microbench_baseline.csv");
+        std::string line;
+        while(std::getline(fin, line))
+        {
+            size_t comma = line.rfind(',');
+            if(comma == std::string::npos)
+                continue;
+            gBaseline[line.substr(0, comma)] = atof(line.c_str() + comma + 1);
+        }
+    }
+
+    void SaveResults()
+    {
+        std::ofstream fout("microbench.csv", std::ios::trunc);
+        for(const auto& kv : gResults)
+            fout << kv.first << "," << kv.second << "\n";
+    }
+}
+
+// Steps the solver; dt equals the constructed timestep so every call runs
+// one full finite-difference pass plus the normal/tangent rebuild.
+static void BenchWaves(int gridSize, int steps, int repetitions)
+{
+    Waves waves(gridSize, gridSize, 1.0f, 0.03f, 4.0f, 0.2f);
+
+    // A few ripples so the solver works on non-trivial data, then warmup.
+    for(int i = 0; i < 16; ++i)
+        waves.Disturb(MathHelper::Rand(4, gridSize - 5), MathHelper::Rand(4, gridSize - 5),
+            MathHelper::RandF(0.2f, 0.5f));
+    for(int i = 0; i < 32; ++i)
+        waves.Update(0.03f);
+
+    double ms = TimeBest(repetitions, [&]
+    {
+        for(int i = 0; i < steps; ++i)
+            waves.Update(0.03f);
+    });
+
+    char name[64];
+    sprintf_s(name, "waves_update_%dx%d", gridSize, gridSize);
+
+    // Steps per second and the vertex throughput of the update loops.
+    double stepsPerSec = steps / (ms / 1000.0);
+    double mVertsPerSec = stepsPerSec * waves.VertexCount() / 1.0e6;
+
+    char extra[64];
+    sprintf_s(extra, "%.0f steps/s %.1f MVerts/s", stepsPerSec, mVertsPerSec);
+    Report(name, ms, extra);
+}
+
+// CreateGeosphere is the Subdivide stress case: vertex count quadruples per
+// level, so the higher levels are dominated by Subdivide and the vertex
+// normalization loop.
+static void BenchGeosphere(UINT subdivisions, int repetitions)
+{
+    GeometryGenerator geoGen;
+    GeometryGenerator::MeshData mesh;
+
+    // Warmup.
+    mesh = geoGen.CreateGeosphere(1.0f, subdivisions);
+
+    double ms = TimeBest(repetitions, [&]
+    {
+        mesh = geoGen.CreateGeosphere(1.0f, subdivisions);
+    });
+
+    char name[64];
+    sprintf_s(name, "geosphere_subdiv_%u", subdivisions);
+
+    char extra[64];
+    sprintf_s(extra, "%zu verts", mesh.Vertices.size());
+    Report(name, ms, extra);
+}
+
+int main()
+{
+    __int64 countsPerSec;
+    QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+    gSecondsPerCount = 1.0 / (double)countsPerSec;
+
+    // Keep the timing thread on one core so the best-of runs compare like
+    // with like.
+    SetThreadAffinityMask(GetCurrentThread(), 1);
+
+    LoadBaseline();
+
+    const int repetitions = 5;
+
+    BenchWaves(64, 200, repetitions);
+    BenchWaves(128, 200, repetitions);
+    BenchWaves(256, 50, repetitions);
+
+    for(UINT subdiv = 2; subdiv <= 6; ++subdiv)
+        BenchGeosphere(subdiv, repetitions);
+
+    SaveResults();
+    printf("\nResults written to microbench.csv; rename to"
+           " microbench_baseline.csv to compare the next run against it.\n");
+
+    return 0;
+}
@@ -1,17 +1,44 @@
 #include "FrameResource.h"
 
+#include "../../Common/GpuMemoryTracker.h"
+
 FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount)
 {
     ThrowIfFailed(device->CreateCommandAllocator(
         D3D12_COMMAND_LIST_TYPE_DIRECT,
         IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
 
-    //  FrameCB = std::make_unique<UploadBuffer<FrameConstants>>(device, 1, true);
-    PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
-    MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
-    ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+    for (int i = 0; i < NumDrawThreads; ++i)
+    {
+        ThrowIfFailed(device->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            IID_PPV_ARGS(LayerCmdListAlloc[i].GetAddressOf())));
+    }
+
+    Ring = std::make_unique<UploadRing>(device);
+    Arena = std::make_unique<FrameArena>();
+
+    WavesVB = std::make_unique<UploadBuffer<WaterDynamicVertex>>(device, waveVertCount, false);
 
-    WavesVB = std::make_unique<UploadBuffer<Vertex>>(device, waveVertCount, false);
+    ThrowIfFailed(device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(objectCount*sizeof(UINT64)),
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(OcclusionReadback.GetAddressOf())));
+    GpuMemoryTracker::Instance().Track(OcclusionReadback.Get(), GpuMemoryTracker::Category::Readback);
+    ThrowIfFailed(OcclusionReadback->Map(0, nullptr, reinterpret_cast<void**>(&OcclusionResults)));
+
+    ThrowIfFailed(device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(NumGpuTimers*2*sizeof(UINT64)),
+        D3D12_RESOURCE_STATE_COPY_DEST,
+        nullptr,
+        IID_PPV_ARGS(GpuTimerReadback.GetAddressOf())));
+    GpuMemoryTracker::Instance().Track(GpuTimerReadback.Get(), GpuMemoryTracker::Category::Readback);
+    ThrowIfFailed(GpuTimerReadback->Map(0, nullptr, reinterpret_cast<void**>(&GpuTimerResults)));
 }
 
 FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount)
@@ -20,14 +47,26 @@ FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCo
         D3D12_COMMAND_LIST_TYPE_DIRECT,
         IID_PPV_ARGS(CmdListAlloc.GetAddressOf())));
 
-    //  FrameCB = std::make_unique<UploadBuffer<FrameConstants>>(device, 1, true);
-    PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
-    MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
-    ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+    for (int i = 0; i < NumDrawThreads; ++i)
+    {
+        ThrowIfFailed(device->CreateCommandAllocator(
+            D3D12_COMMAND_LIST_TYPE_DIRECT,
+            IID_PPV_ARGS(LayerCmdListAlloc[i].GetAddressOf())));
+    }
 
+    Ring = std::make_unique<UploadRing>(device);
+    Arena = std::make_unique<FrameArena>();
 }
 
 FrameResource::~FrameResource()
 {
+    if(OcclusionReadback != nullptr)
+        OcclusionReadback->Unmap(0, nullptr);
+
+    OcclusionResults = nullptr;
+
+    if(GpuTimerReadback != nullptr)
+        GpuTimerReadback->Unmap(0, nullptr);
 
+    GpuTimerResults = nullptr;
 }
@@ -3,11 +3,34 @@
 #include "../../Common/d3dUtil.h"
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
+#include "../../Common/UploadRing.h"
+#include "../../Common/FrameArena.h"
+#include <DirectXPackedVector.h>
 
 struct ObjectConstants
 {
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+
+    // Point lights affecting this object: up to eight indices into the
+    // scene light buffer, packed 8 bits apiece, culled on the CPU against
+    // the object's world bounds.
+    UINT PackedLightIndices[2] = { 0, 0 };
+    UINT LightCount = 0;
+    UINT ObjPad0 = 0;
+};
+
+// Per-instance data for the instanced opaque path.  Must match the
+// InstanceData structured buffer declared in Default.hlsl.
+struct InstanceData
+{
+    DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
+    DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+
+    // Same packed per-object light list as ObjectConstants.
+    UINT PackedLightIndices[2] = { 0, 0 };
+    UINT LightCount = 0;
+    UINT InstPad0 = 0;
 };
 
 struct PassConstants
@@ -48,12 +71,41 @@ struct Vertex
 	DirectX::XMFLOAT2 TexC;
 };
 
+// 16-byte packed vertex for the static castle geometry: half4 position,
+// 10:10:10:2 biased normal (decoded as n*2-1 in the vertex shader), half2
+// texture coordinates.  The 32-byte Vertex above stays in use for the
+// dynamic wave vertex buffers, which the CPU rewrites every frame.
+struct CompressedVertex
+{
+    DirectX::PackedVector::XMHALF4 Pos;
+    DirectX::PackedVector::XMUDECN4 Normal;
+    DirectX::PackedVector::XMHALF2 TexC;
+};
+
+// Per-frame stream for the CPU wave path.  The x/z positions and UVs of the
+// water grid never change and live in a static buffer uploaded once; only
+// the height and the biased 10:10:10:2 normal are rewritten each frame.
+struct WaterDynamicVertex
+{
+    float Height;
+    DirectX::PackedVector::XMUDECN4 Normal;
+};
+
 // Stores the resources needed for the CPU to build the command lists
-// for a frame.  
+// for a frame.
 struct FrameResource
 {
 public:
-    
+
+    // One recording thread per drawn render layer (opaque, tree sprites,
+    // transparent).  Command allocators cannot be shared between threads, so
+    // each worker gets its own per frame.
+    static const int NumDrawThreads = 3;
+
+    // GPU timestamp pairs recorded per frame: the wave simulation work plus
+    // one pair per drawn render layer.
+    static const int NumGpuTimers = 1 + NumDrawThreads;
+
     FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount);
 	FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
     FrameResource(const FrameResource& rhs) = delete;
@@ -64,16 +116,38 @@ public:
     // So each frame needs their own allocator.
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
 
-    // We cannot update a cbuffer until the GPU is done processing the commands
-    // that reference it.  So each frame needs their own cbuffers.
-   // std::unique_ptr<UploadBuffer<FrameConstants>> FrameCB = nullptr;
-    std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
-    std::unique_ptr<UploadBuffer<MaterialConstants>> MaterialCB = nullptr;
-    std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
+    // Per-thread allocators for the parallel layer recording in Draw.
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> LayerCmdListAlloc[NumDrawThreads];
+
+    // We cannot update per-frame GPU data until the GPU is done processing
+    // the commands that reference it, so each frame owns its own ring.  The
+    // pass constants, material constants, and instance transforms are all
+    // suballocated from it every frame; per-object World/TexTransform bind
+    // as root constants straight from the app's item-constants pool, so
+    // there is no ObjectCB either.
+    std::unique_ptr<UploadRing> Ring = nullptr;
+
+    // System-memory twin of the ring: the frame loop's scratch containers
+    // (visible lists, sort scratch) suballocate from it, so steady-state
+    // frames never touch the global heap.  Reset alongside the ring.
+    std::unique_ptr<FrameArena> Arena = nullptr;
 
     // We cannot update a dynamic vertex buffer until the GPU is done processing
     // the commands that reference it.  So each frame needs their own.
-    std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
+    std::unique_ptr<UploadBuffer<WaterDynamicVertex>> WavesVB = nullptr;
+
+    // Occlusion query pass: the readback buffer ResolveQueryData fills.  The
+    // results are consumed when this frame resource next comes around, after
+    // its fence wait.  The box world transforms ride the object root
+    // constants, so no buffer is needed for them.
+    Microsoft::WRL::ComPtr<ID3D12Resource> OcclusionReadback;
+    UINT64* OcclusionResults = nullptr;
+
+    // GPU timestamp readback, two ticks (begin/end) per timer.  Like the
+    // occlusion results, a frame's timings are read when its frame resource
+    // next comes around, after the fence wait.
+    Microsoft::WRL::ComPtr<ID3D12Resource> GpuTimerReadback;
+    UINT64* GpuTimerResults = nullptr;
 
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
@@ -0,0 +1,351 @@
+//***************************************************************************************
+// GpuWaves.cpp
+//***************************************************************************************
+
+#include "GpuWaves.h"
+#include <cassert>
+#include <vector>
+
+#include "../../Common/GpuMemoryTracker.h"
+
+using Microsoft::WRL::ComPtr;
+using namespace DirectX;
+
+// Must match struct Vertex in FrameResource.h and WaveVertex in WaveSim.hlsl.
+namespace
+{
+    struct WaveVertex
+    {
+        XMFLOAT3 Pos;
+        XMFLOAT3 Normal;
+        XMFLOAT2 TexC;
+    };
+}
+
+GpuWaves::GpuWaves(ID3D12Device* device,
+                   ID3D12GraphicsCommandList* cmdList,
+                   int m, int n, float dx, float dt, float speed, float damping)
+{
+    md3dDevice = device;
+
+    mNumRows = m;
+    mNumCols = n;
+
+    assert((m * n) % 256 == 0);
+
+    mVertexCount = m * n;
+    mTriangleCount = (m - 1) * (n - 1) * 2;
+
+    mTimeStep = dt;
+    mSpatialStep = dx;
+
+    float d = damping * dt + 2.0f;
+    float e = (speed * speed) * (dt * dt) / (dx * dx);
+    mK1 = (damping * dt - 2.0f) / d;
+    mK2 = (4.0f - 8.0f * e) / d;
+    mK3 = (2.0f * e) / d;
+
+    BuildResources(cmdList);
+    BuildRootSignature(device);
+}
+
+int GpuWaves::RowCount()const
+{
+    return mNumRows;
+}
+
+int GpuWaves::ColumnCount()const
+{
+    return mNumCols;
+}
+
+int GpuWaves::VertexCount()const
+{
+    return mVertexCount;
+}
+
+int GpuWaves::TriangleCount()const
+{
+    return mTriangleCount;
+}
+
+float GpuWaves::Width()const
+{
+    return mNumCols * mSpatialStep;
+}
+
+float GpuWaves::Depth()const
+{
+    return mNumRows * mSpatialStep;
+}
+
+float GpuWaves::SpatialStep()const
+{
+    return mSpatialStep;
+}
+
+ID3D12Resource* GpuWaves::VertexBuffer()const
+{
+    return mVertexBuffer.Get();
+}
+
+void GpuWaves::BuildResources(ID3D12GraphicsCommandList* cmdList)
+{
+    // Height planes are structured buffers of float so they can be bound as
+    // root UAVs (no descriptor heap traffic for the sim).
+    UINT64 solByteSize = (UINT64)mVertexCount * sizeof(float);
+
+    auto solDesc = CD3DX12_RESOURCE_DESC::Buffer(solByteSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+    ThrowIfFailed(md3dDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &solDesc,
+        D3D12_RESOURCE_STATE_COMMON,
+        nullptr,
+        IID_PPV_ARGS(&mPrevSol)));
+    GpuMemoryTracker::Instance().Track(mPrevSol.Get(), GpuMemoryTracker::Category::Other);
+
+    ThrowIfFailed(md3dDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &solDesc,
+        D3D12_RESOURCE_STATE_COMMON,
+        nullptr,
+        IID_PPV_ARGS(&mCurrSol)));
+    GpuMemoryTracker::Instance().Track(mCurrSol.Get(), GpuMemoryTracker::Category::Other);
+
+    ThrowIfFailed(md3dDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &solDesc,
+        D3D12_RESOURCE_STATE_COMMON,
+        nullptr,
+        IID_PPV_ARGS(&mNextSol)));
+    GpuMemoryTracker::Instance().Track(mNextSol.Get(), GpuMemoryTracker::Category::Other);
+
+    UINT64 vbByteSize = (UINT64)mVertexCount * sizeof(WaveVertex);
+
+    auto vbDesc = CD3DX12_RESOURCE_DESC::Buffer(vbByteSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+
+    ThrowIfFailed(md3dDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+        D3D12_HEAP_FLAG_NONE,
+        &vbDesc,
+        D3D12_RESOURCE_STATE_COMMON,
+        nullptr,
+        IID_PPV_ARGS(&mVertexBuffer)));
+    GpuMemoryTracker::Instance().Track(mVertexBuffer.Get(), GpuMemoryTracker::Category::Other);
+
+    // Default-heap contents are undefined, so zero the height planes once at
+    // startup.  The upload buffer must stay alive until the init command list
+    // has executed, same as the MeshGeometry uploaders.
+    std::vector<float> zeros(mVertexCount, 0.0f);
+
+    ThrowIfFailed(md3dDevice->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(solByteSize),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&mZeroUploadBuffer)));
+    GpuMemoryTracker::Instance().Track(mZeroUploadBuffer.Get(), GpuMemoryTracker::Category::Upload);
+
+    BYTE* mappedData = nullptr;
+    ThrowIfFailed(mZeroUploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mappedData)));
+    memcpy(mappedData, zeros.data(), (size_t)solByteSize);
+    mZeroUploadBuffer->Unmap(0, nullptr);
+
+    ID3D12Resource* sols[] = {mPrevSol.Get(), mCurrSol.Get(), mNextSol.Get()};
+    for (auto sol : sols)
+    {
+        cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(sol,
+                                                                          D3D12_RESOURCE_STATE_COMMON,
+                                                                          D3D12_RESOURCE_STATE_COPY_DEST));
+        cmdList->CopyBufferRegion(sol, 0, mZeroUploadBuffer.Get(), 0, solByteSize);
+        cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(sol,
+                                                                          D3D12_RESOURCE_STATE_COPY_DEST,
+                                                                          D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+    }
+
+    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mVertexBuffer.Get(),
+                                                                      D3D12_RESOURCE_STATE_COMMON,
+                                                                      D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+}
+
+void GpuWaves::BuildRootSignature(ID3D12Device* device)
+{
+    // Root parameter layout:
+    // [0] root constants (sim constants + disturb args)
+    // [1] u0: previous heights
+    // [2] u1: current heights
+    // [3] u2: next heights
+    // [4] u3: output vertex buffer
+    CD3DX12_ROOT_PARAMETER slotRootParameter[5];
+    slotRootParameter[0].InitAsConstants(9, 0);
+    slotRootParameter[1].InitAsUnorderedAccessView(0);
+    slotRootParameter[2].InitAsUnorderedAccessView(1);
+    slotRootParameter[3].InitAsUnorderedAccessView(2);
+    slotRootParameter[4].InitAsUnorderedAccessView(3);
+
+    CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(5, slotRootParameter,
+                                            0, nullptr,
+                                            D3D12_ROOT_SIGNATURE_FLAG_NONE);
+
+    ComPtr<ID3DBlob> serializedRootSig = nullptr;
+    ComPtr<ID3DBlob> errorBlob = nullptr;
+    HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+                                             serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+
+    if (errorBlob != nullptr)
+    {
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+    }
+    ThrowIfFailed(hr);
+
+    ThrowIfFailed(device->CreateRootSignature(
+        0,
+        serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+}
+
+void GpuWaves::BuildPSOs(ID3DBlob* updateCS, ID3DBlob* buildVertsCS, ID3DBlob* disturbCS)
+{
+    D3D12_COMPUTE_PIPELINE_STATE_DESC updatePsoDesc = {};
+    updatePsoDesc.pRootSignature = mRootSignature.Get();
+    updatePsoDesc.CS =
+    {
+        reinterpret_cast<BYTE*>(updateCS->GetBufferPointer()),
+        updateCS->GetBufferSize()
+    };
+    updatePsoDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;
+    ThrowIfFailed(md3dDevice->CreateComputePipelineState(&updatePsoDesc, IID_PPV_ARGS(&mUpdatePSO)));
+
+    D3D12_COMPUTE_PIPELINE_STATE_DESC buildVertsPsoDesc = updatePsoDesc;
+    buildVertsPsoDesc.CS =
+    {
+        reinterpret_cast<BYTE*>(buildVertsCS->GetBufferPointer()),
+        buildVertsCS->GetBufferSize()
+    };
+    ThrowIfFailed(md3dDevice->CreateComputePipelineState(&buildVertsPsoDesc, IID_PPV_ARGS(&mBuildVertsPSO)));
+
+    D3D12_COMPUTE_PIPELINE_STATE_DESC disturbPsoDesc = updatePsoDesc;
+    disturbPsoDesc.CS =
+    {
+        reinterpret_cast<BYTE*>(disturbCS->GetBufferPointer()),
+        disturbCS->GetBufferSize()
+    };
+    ThrowIfFailed(md3dDevice->CreateComputePipelineState(&disturbPsoDesc, IID_PPV_ARGS(&mDisturbPSO)));
+}
+
+void GpuWaves::Disturb(ID3D12GraphicsCommandList* cmdList, int i, int j, float magnitude)
+{
+    // Don't disturb boundaries.
+    assert(i > 1 && i < mNumRows - 2);
+    assert(j > 1 && j < mNumCols - 2);
+
+    cmdList->SetPipelineState(mDisturbPSO.Get());
+    cmdList->SetComputeRootSignature(mRootSignature.Get());
+
+    UINT constants[9] = {0};
+    memcpy(&constants[0], &mK1, sizeof(float));
+    memcpy(&constants[1], &mK2, sizeof(float));
+    memcpy(&constants[2], &mK3, sizeof(float));
+    memcpy(&constants[3], &magnitude, sizeof(float));
+    constants[4] = (UINT)j; // x = column
+    constants[5] = (UINT)i; // y = row
+    memcpy(&constants[6], &mSpatialStep, sizeof(float));
+    constants[7] = (UINT)mNumCols;
+    constants[8] = (UINT)mNumRows;
+    cmdList->SetComputeRoot32BitConstants(0, 9, constants, 0);
+
+    cmdList->SetComputeRootUnorderedAccessView(1, mPrevSol->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(2, mCurrSol->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(3, mNextSol->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(4, mVertexBuffer->GetGPUVirtualAddress());
+
+    // One thread group pokes the disturb point and its four neighbors.
+    cmdList->Dispatch(1, 1, 1);
+
+    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(mCurrSol.Get()));
+}
+
+void GpuWaves::Update(const GameTimer& gt, ID3D12GraphicsCommandList* cmdList)
+{
+    // Accumulate time; only step the solver at the fixed time step, like the
+    // CPU Waves class.
+    mAccumulatedTime += gt.DeltaTime();
+
+    if (mAccumulatedTime < mTimeStep && !mFirstRun)
+        return;
+
+    // After the first Update the vertex buffer was left readable for the
+    // transparent draw, so bring it back to UAV for the rebuild pass.
+    if (!mFirstRun)
+    {
+        cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mVertexBuffer.Get(),
+                                                                          D3D12_RESOURCE_STATE_GENERIC_READ,
+                                                                          D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+    }
+
+    cmdList->SetComputeRootSignature(mRootSignature.Get());
+
+    UINT constants[9] = {0};
+    memcpy(&constants[0], &mK1, sizeof(float));
+    memcpy(&constants[1], &mK2, sizeof(float));
+    memcpy(&constants[2], &mK3, sizeof(float));
+    // constants[3..5] are disturb args, unused by these kernels.
+    memcpy(&constants[6], &mSpatialStep, sizeof(float));
+    constants[7] = (UINT)mNumCols;
+    constants[8] = (UINT)mNumRows;
+    cmdList->SetComputeRoot32BitConstants(0, 9, constants, 0);
+
+    if (mAccumulatedTime >= mTimeStep)
+    {
+        mAccumulatedTime = 0.0f;
+
+        cmdList->SetPipelineState(mUpdatePSO.Get());
+
+        cmdList->SetComputeRootUnorderedAccessView(1, mPrevSol->GetGPUVirtualAddress());
+        cmdList->SetComputeRootUnorderedAccessView(2, mCurrSol->GetGPUVirtualAddress());
+        cmdList->SetComputeRootUnorderedAccessView(3, mNextSol->GetGPUVirtualAddress());
+        cmdList->SetComputeRootUnorderedAccessView(4, mVertexBuffer->GetGPUVirtualAddress());
+
+        // 16x16 threads per group; WaveSim.hlsl clamps against the boundary.
+        UINT numGroupsX = (UINT)ceilf(mNumCols / 16.0f);
+        UINT numGroupsY = (UINT)ceilf(mNumRows / 16.0f);
+        cmdList->Dispatch(numGroupsX, numGroupsY, 1);
+
+        // Ping-pong: next becomes current, current becomes previous, and the
+        // old previous buffer is recycled as the next scratch target.
+        auto resTemp = mPrevSol;
+        mPrevSol = mCurrSol;
+        mCurrSol = mNextSol;
+        mNextSol = resTemp;
+
+        cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(mCurrSol.Get()));
+    }
+
+    mFirstRun = false;
+
+    //
+    // Rebuild position/normal/tangent vertex data from the new heights.
+    //
+    cmdList->SetPipelineState(mBuildVertsPSO.Get());
+
+    cmdList->SetComputeRootUnorderedAccessView(1, mPrevSol->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(2, mCurrSol->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(3, mNextSol->GetGPUVirtualAddress());
+    cmdList->SetComputeRootUnorderedAccessView(4, mVertexBuffer->GetGPUVirtualAddress());
+
+    UINT numGroupsX = (UINT)ceilf(mNumCols / 16.0f);
+    UINT numGroupsY = (UINT)ceilf(mNumRows / 16.0f);
+    cmdList->Dispatch(numGroupsX, numGroupsY, 1);
+
+    // The transparent layer reads this buffer as a vertex buffer later in the
+    // frame; it is transitioned back to UAV at the start of the next update.
+    cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mVertexBuffer.Get(),
+                                                                      D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+                                                                      D3D12_RESOURCE_STATE_GENERIC_READ));
+}
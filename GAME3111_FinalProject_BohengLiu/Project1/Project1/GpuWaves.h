@@ -0,0 +1,93 @@
+//***************************************************************************************
+// GpuWaves.h
+//
+// Performs the wave simulation entirely on the GPU with a compute shader
+// (Shaders\WaveSim.hlsl).  The height field lives in ping-ponged structured
+// buffers and a second kernel rebuilds position/normal/tangent data straight
+// into a default-heap vertex buffer, so the CPU never touches per-vertex data
+// and nothing is re-uploaded through FrameResource::WavesVB per frame.
+//***************************************************************************************
+
+#ifndef GPUWAVES_H
+#define GPUWAVES_H
+
+#include "../../Common/d3dUtil.h"
+#include "../../Common/GameTimer.h"
+
+class GpuWaves
+{
+public:
+    // Note: the compiled compute shaders are passed in so shader building stays
+    // in CastleApp::BuildShadersAndInputLayout with the rest of the shaders.
+    GpuWaves(ID3D12Device* device,
+             ID3D12GraphicsCommandList* cmdList,
+             int m, int n, float dx, float dt, float speed, float damping);
+    GpuWaves(const GpuWaves& rhs) = delete;
+    GpuWaves& operator=(const GpuWaves& rhs) = delete;
+    ~GpuWaves() = default;
+
+    int RowCount()const;
+    int ColumnCount()const;
+    int VertexCount()const;
+    int TriangleCount()const;
+    float Width()const;
+    float Depth()const;
+    float SpatialStep()const;
+
+    // The vertex buffer the water RenderItem draws from.  Contents match
+    // struct Vertex in FrameResource.h.
+    ID3D12Resource* VertexBuffer()const;
+
+    void BuildPSOs(ID3DBlob* updateCS, ID3DBlob* buildVertsCS, ID3DBlob* disturbCS);
+
+    // Records a disturb dispatch; magnitude is applied to (i,j) and half to its neighbors.
+    void Disturb(ID3D12GraphicsCommandList* cmdList, int i, int j, float magnitude);
+
+    // Records the solver + vertex rebuild dispatches for one frame.  Internally
+    // gated to the fixed simulation time step like the CPU Waves class.
+    void Update(const GameTimer& gt, ID3D12GraphicsCommandList* cmdList);
+
+private:
+    void BuildResources(ID3D12GraphicsCommandList* cmdList);
+    void BuildRootSignature(ID3D12Device* device);
+
+    int mNumRows = 0;
+    int mNumCols = 0;
+
+    int mVertexCount = 0;
+    int mTriangleCount = 0;
+
+    // Simulation constants we can precompute.
+    float mK1 = 0.0f;
+    float mK2 = 0.0f;
+    float mK3 = 0.0f;
+
+    float mTimeStep = 0.0f;
+    float mSpatialStep = 0.0f;
+
+    // Accumulates frame time so the solver only steps at the fixed time step.
+    float mAccumulatedTime = 0.0f;
+
+    // The first Update always rebuilds the vertex buffer so the water can be
+    // drawn before the first simulation step is due.
+    bool mFirstRun = true;
+
+    ID3D12Device* md3dDevice = nullptr;
+
+    Microsoft::WRL::ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> mUpdatePSO = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> mBuildVertsPSO = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12PipelineState> mDisturbPSO = nullptr;
+
+    // Ping-ponged height planes (structured buffers of float) bound as root UAVs.
+    Microsoft::WRL::ComPtr<ID3D12Resource> mPrevSol = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> mCurrSol = nullptr;
+    Microsoft::WRL::ComPtr<ID3D12Resource> mNextSol = nullptr;
+
+    // Vertex buffer rebuilt by the compute shader each simulation step.
+    Microsoft::WRL::ComPtr<ID3D12Resource> mVertexBuffer = nullptr;
+
+    Microsoft::WRL::ComPtr<ID3D12Resource> mZeroUploadBuffer = nullptr;
+};
+
+#endif // GPUWAVES_H
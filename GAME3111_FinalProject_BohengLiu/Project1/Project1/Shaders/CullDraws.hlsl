@@ -0,0 +1,118 @@
+//***************************************************************************************
+// CullDraws.hlsl: culling and compaction for the GPU-driven opaque pass.
+//
+// One thread per opaque draw record: test the item's world AABB against the
+// camera frustum, pick its detail level from the view distance, and append a
+// packed indirect argument record for the survivors.  ExecuteIndirect then
+// replays the whole layer from the one buffer this pass fills.
+//***************************************************************************************
+
+// Must match GpuDrawRecord in CastleApp.cpp.
+struct DrawRecord
+{
+	float3 BoundsCenter;
+	uint   LodCount;
+	float3 BoundsExtents;
+	uint   MatCBOffset;
+
+	uint2  VbvAddress;
+	uint   VbvSizeInBytes;
+	uint   VbvStrideInBytes;
+	uint2  IbvAddress;
+	uint   IbvSizeInBytes;
+	uint   IbvFormat;
+
+	uint   IndexCount[3];
+	uint   StartIndexLocation[3];
+	int    BaseVertexLocation[3];
+	uint   RecordPad0;
+
+	// Pre-transposed on the CPU exactly as the root-constant upload sends
+	// them; row_major keeps the 64-byte copy below verbatim.
+	row_major float4x4 World;
+	row_major float4x4 TexTransform;
+	uint2  PackedLightIndices;
+	uint   LightCount;
+	uint   ObjPad0;
+};
+
+cbuffer cbCull : register(b0)
+{
+	// Inward-facing frustum planes: left, right, bottom, top, near, far.
+	float4 gPlanes[6];
+	float3 gEyePosW;
+	uint   gDrawCount;
+
+	// This frame's material constant run in the upload ring, split into
+	// 32-bit halves; each draw's CBV argument is base plus record offset.
+	uint2  gMaterialBaseVA;
+	uint2  cbCullPad;
+};
+
+StructuredBuffer<DrawRecord> gDrawRecords : register(t0);
+
+// Survivor count in the first four bytes (read back by ExecuteIndirect as
+// the count buffer); packed argument records from byte 16, written raw so
+// one buffer carries the mixed layout the command signature consumes.
+RWByteAddressBuffer gDrawArgs : register(u0);
+
+// Must match gGpuDrawArgsBase/gGpuDrawArgsStride in CastleApp.cpp.
+static const uint gArgsBase = 16;
+static const uint gArgsStride = 208;
+
+void StoreMatrix(uint addr, float4x4 m)
+{
+	gDrawArgs.Store4(addr +  0, asuint(m[0]));
+	gDrawArgs.Store4(addr + 16, asuint(m[1]));
+	gDrawArgs.Store4(addr + 32, asuint(m[2]));
+	gDrawArgs.Store4(addr + 48, asuint(m[3]));
+}
+
+[numthreads(64, 1, 1)]
+void CS(uint3 dtid : SV_DispatchThreadID)
+{
+	if (dtid.x >= gDrawCount)
+		return;
+
+	DrawRecord rec = gDrawRecords[dtid.x];
+
+	// Plane test against the world AABB: the item is out once its center
+	// sits farther behind any plane than the box's projected radius.
+	[unroll]
+	for (int p = 0; p < 6; ++p)
+	{
+		float dist = dot(gPlanes[p].xyz, rec.BoundsCenter) + gPlanes[p].w;
+		float radius = dot(abs(gPlanes[p].xyz), rec.BoundsExtents);
+		if (dist < -radius)
+			return;
+	}
+
+	// Same detail-level thresholds CullRenderItems uses on the CPU path.
+	float d = length(rec.BoundsCenter - gEyePosW);
+	uint lod = d < 30.0f ? 0 : (d < 60.0f ? 1 : 2);
+	lod = min(lod, rec.LodCount - 1);
+
+	uint slot;
+	gDrawArgs.InterlockedAdd(0, 1, slot);
+	uint addr = gArgsBase + slot * gArgsStride;
+
+	// Vertex and index buffer views.
+	gDrawArgs.Store4(addr +  0, uint4(rec.VbvAddress, rec.VbvSizeInBytes, rec.VbvStrideInBytes));
+	gDrawArgs.Store4(addr + 16, uint4(rec.IbvAddress, rec.IbvSizeInBytes, rec.IbvFormat));
+
+	// Material constant buffer address, 64-bit add with manual carry.
+	uint matLo = gMaterialBaseVA.x + rec.MatCBOffset;
+	uint matHi = gMaterialBaseVA.y + (matLo < gMaterialBaseVA.x ? 1 : 0);
+	gDrawArgs.Store2(addr + 32, uint2(matLo, matHi));
+
+	// Object root constants, verbatim from the record.
+	StoreMatrix(addr + 40, rec.World);
+	StoreMatrix(addr + 104, rec.TexTransform);
+	gDrawArgs.Store4(addr + 168, uint4(rec.PackedLightIndices, rec.LightCount, rec.ObjPad0));
+
+	// DrawIndexedInstanced arguments for the chosen detail level.
+	gDrawArgs.Store4(addr + 184, uint4(rec.IndexCount[lod], 1,
+	                                   rec.StartIndexLocation[lod],
+	                                   asuint(rec.BaseVertexLocation[lod])));
+	gDrawArgs.Store(addr + 200, 0);
+}
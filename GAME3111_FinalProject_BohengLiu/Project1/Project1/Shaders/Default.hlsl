@@ -20,7 +20,24 @@
 // Include structures and functions for lighting.
 #include "LightingUtil.hlsl"
 
-Texture2D    gDiffuseMap : register(t0);
+// All scene diffuse maps, bound once per command list; each material selects
+// its texture through gDiffuseMapIndex instead of a per-draw table bind.
+// The four same-size BC1 castle maps (bricks, bricks3, ice, checkboard) pack
+// into gCastleMapArray; their materials set gDiffuseMapIndex to its heap
+// slot (4) and pick a slice with gDiffuseArraySlice.
+Texture2D      gDiffuseMap[4]  : register(t0);
+Texture2DArray gCastleMapArray : register(t4);
+
+static const uint gCastleMapArrayIndex = 4;
+
+// Baked ambient-cube light volume for the static geometry: six axis slabs
+// (+x,-x,+y,-y,+z,-z) packed along x in one 3D texture, one world unit per
+// cell.  Bounds and dimensions must match CastleApp::BakeLightVolume.
+Texture3D gLightVolume : register(t6);
+
+static const float3 gLightVolumeMin = float3(-40.0f, 0.0f, -40.0f);
+static const float3 gLightVolumeInvSize = float3(1.0f / 80.0f, 1.0f / 20.0f, 1.0f / 80.0f);
+static const float gLightVolumeCellsX = 80.0f;
 
 
 SamplerState gsamPointWrap        : register(s0);
@@ -30,13 +47,38 @@ SamplerState gsamLinearClamp      : register(s3);
 SamplerState gsamAnisotropicWrap  : register(s4);
 SamplerState gsamAnisotropicClamp : register(s5);
 
-// Constant data that varies per frame.
+// Constant data that varies per frame.  The packed light list holds up to
+// eight indices into gPointLights, 8 bits apiece, culled on the CPU against
+// the object's world bounds.
 cbuffer cbPerObject : register(b0)
 {
     float4x4 gWorld;
 	float4x4 gTexTransform;
+    uint2    gPackedLightIndices;
+    uint     gLightCount;
+    uint     gObjPad0;
+};
+
+#ifdef INSTANCING
+// Per-instance data for the instanced opaque path; one DrawIndexedInstanced
+// covers every castle piece sharing a (geometry, material) pair.
+struct InstanceData
+{
+    float4x4 World;
+    float4x4 TexTransform;
+    uint2    PackedLightIndices;
+    uint     LightCount;
+    uint     InstPad0;
 };
 
+StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
+#endif
+
+// All scene point lights; each object evaluates only the ones its packed
+// light list names, so per-pixel cost no longer scales with the scene's
+// light count.
+StructuredBuffer<Light> gPointLights : register(t1, space1);
+
 // Constant data that varies per material.
 cbuffer cbPass : register(b1)
 {
@@ -74,14 +116,38 @@ cbuffer cbMaterial : register(b2)
     float3   gFresnelR0;
     float    gRoughness;
 	float4x4 gMatTransform;
+	uint     gDiffuseMapIndex;
+	uint     gDiffuseArraySlice;
+	uint     gMaterialPad1;
+	uint     gMaterialPad2;
 };
 
+#ifdef WATER_HEIGHT_STREAM
+// Split water streams: slot 0 carries the static x/z position and UV, slot 1
+// the per-frame height and 10:10:10:2 biased normal.
+struct VertexIn
+{
+	float2 PosXZ   : POSITION;
+	float2 TexC    : TEXCOORD;
+	float  Height  : HEIGHT;
+	float3 NormalL : NORMAL;
+};
+#elif defined(WATER_ANALYTIC)
+// Analytic water reads only the static grid; displacement and normal are
+// computed in the vertex shader from gTotalTime.
+struct VertexIn
+{
+	float2 PosXZ   : POSITION;
+	float2 TexC    : TEXCOORD;
+};
+#else
 struct VertexIn
 {
 	float3 PosL    : POSITION;
     float3 NormalL : NORMAL;
 	float2 TexC    : TEXCOORD;
 };
+#endif
 
 struct VertexOut
 {
@@ -89,24 +155,110 @@ struct VertexOut
     float3 PosW    : POSITION;
     float3 NormalW : NORMAL;
 	float2 TexC    : TEXCOORD;
+    nointerpolation uint2 LightIndices : LIGHTINDICES;
+    nointerpolation uint  LightCount   : LIGHTCOUNT;
 };
 
+// Samples one axis slab of the light volume; u stays half a texel inside
+// the slab so linear filtering never bleeds into the neighbouring axis.
+float3 SampleLightVolumeAxis(float3 uvw, float axis)
+{
+    float halfTexel = 0.5f / gLightVolumeCellsX;
+    float u = (axis + clamp(uvw.x, halfTexel, 1.0f - halfTexel)) / 6.0f;
+    return gLightVolume.SampleLevel(gsamLinearClamp, float3(u, uvw.y, uvw.z), 0.0f).rgb;
+}
+
+// Ambient-cube lookup: blend the three slabs facing the normal, weighted by
+// the squared normal components.
+float3 SampleLightVolume(float3 posW, float3 normalW)
+{
+    float3 uvw = (posW - gLightVolumeMin) * gLightVolumeInvSize;
+    float3 nSq = normalW * normalW;
+
+    float3 irradiance = nSq.x * SampleLightVolumeAxis(uvw, normalW.x >= 0.0f ? 0.0f : 1.0f);
+    irradiance += nSq.y * SampleLightVolumeAxis(uvw, normalW.y >= 0.0f ? 2.0f : 3.0f);
+    irradiance += nSq.z * SampleLightVolumeAxis(uvw, normalW.z >= 0.0f ? 4.0f : 5.0f);
+
+    return irradiance;
+}
+
+#ifdef INSTANCING
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
+#else
 VertexOut VS(VertexIn vin)
+#endif
 {
 	VertexOut vout = (VertexOut)0.0f;
-	
+
+#ifdef INSTANCING
+    float4x4 world = gInstanceData[instanceID].World;
+    float4x4 texTransform = gInstanceData[instanceID].TexTransform;
+    vout.LightIndices = gInstanceData[instanceID].PackedLightIndices;
+    vout.LightCount = gInstanceData[instanceID].LightCount;
+#else
+    float4x4 world = gWorld;
+    float4x4 texTransform = gTexTransform;
+    vout.LightIndices = gPackedLightIndices;
+    vout.LightCount = gLightCount;
+#endif
+
+#if defined(COMPRESSED_VERTS) || defined(WATER_HEIGHT_STREAM)
+    // The packed formats store the normal biased into [0,1] in a
+    // 10:10:10:2 UNORM; unbias it back to a unit vector.
+    float3 normalL = vin.NormalL*2.0f - 1.0f;
+#elif !defined(WATER_ANALYTIC)
+    float3 normalL = vin.NormalL;
+#endif
+
+#if defined(WATER_HEIGHT_STREAM)
+    float3 posL = float3(vin.PosXZ.x, vin.Height, vin.PosXZ.y);
+#elif defined(WATER_ANALYTIC)
+    // Sum of three Gerstner waves driven purely by gTotalTime; the
+    // amplitudes roughly match the simulated grid at rest.
+    const float2 dirs[3] = { float2(0.957f, 0.287f), float2(-0.573f, 0.819f), float2(0.371f, -0.928f) };
+    const float amps[3] = { 0.18f, 0.12f, 0.08f };
+    const float waveLens[3] = { 14.0f, 9.0f, 5.0f };
+    const float speeds[3] = { 4.0f, 3.0f, 2.5f };
+    const float steepness = 0.6f;
+
+    float3 posL = float3(vin.PosXZ.x, 0.0f, vin.PosXZ.y);
+    float3 normalL = float3(0.0f, 1.0f, 0.0f);
+
+    [unroll]
+    for(int k = 0; k < 3; ++k)
+    {
+        float freq = 6.2831853f / waveLens[k];
+        float q = steepness / (freq * amps[k] * 3.0f);
+        float phase = freq * dot(dirs[k], vin.PosXZ) + speeds[k] * freq * gTotalTime;
+
+        float s, c;
+        sincos(phase, s, c);
+
+        posL.xz += q * amps[k] * dirs[k] * c;
+        posL.y += amps[k] * s;
+
+        float wa = freq * amps[k];
+        normalL.xz -= dirs[k] * wa * c;
+        normalL.y -= q * wa * s;
+    }
+
+    normalL = normalize(normalL);
+#else
+    float3 posL = vin.PosL;
+#endif
+
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(posL, 1.0f), world);
     vout.PosW = posW.xyz;
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+    vout.NormalW = mul(normalL, (float3x3)world);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
 	
 	// Output vertex attributes for interpolation across triangle.
-	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
+	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), texTransform);
 	vout.TexC = mul(texC, gMatTransform).xy;
 
     return vout;
@@ -114,7 +266,14 @@ VertexOut VS(VertexIn vin)
 
 float4 PS(VertexOut pin) : SV_Target
 {
-    float4 diffuseAlbedo = gDiffuseMap.Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
+    // The branch is uniform per draw (both operands come from cbMaterial),
+    // so there is no divergence cost.
+    float4 diffuseAlbedo;
+    if(gDiffuseMapIndex == gCastleMapArrayIndex)
+        diffuseAlbedo = gCastleMapArray.Sample(gsamAnisotropicWrap, float3(pin.TexC, gDiffuseArraySlice));
+    else
+        diffuseAlbedo = gDiffuseMap[gDiffuseMapIndex].Sample(gsamAnisotropicWrap, pin.TexC);
+    diffuseAlbedo *= gDiffuseAlbedo;
 	
 #ifdef ALPHA_TEST
 	// Discard pixel if texture alpha < 0.1.  We do this test as soon 
@@ -134,12 +293,28 @@ float4 PS(VertexOut pin) : SV_Target
     // Light terms.
     float4 ambient = gAmbientLight*diffuseAlbedo;
 
+#ifdef BAKED_LIGHTING
+    // Static geometry: direct diffuse comes from the load-time bake, so
+    // the per-light loops are skipped entirely.  Specular is foregone.
+    float4 directLight = float4(SampleLightVolume(pin.PosW, pin.NormalW) * diffuseAlbedo.rgb, 0.0f);
+#else
     const float shininess = 1.0f - gRoughness;
     Material mat = { diffuseAlbedo, gFresnelR0, shininess };
     float3 shadowFactor = 1.0f;
     float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
         pin.NormalW, toEyeW, shadowFactor);
 
+    // Indexed point lights: only the ones the CPU culled against this
+    // object's bounds, unpacked 8 bits per index.
+    for(uint n = 0; n < pin.LightCount; ++n)
+    {
+        uint packed = (n < 4) ? pin.LightIndices.x : pin.LightIndices.y;
+        uint lightIndex = (packed >> (8u * (n & 3u))) & 0xffu;
+        directLight.rgb += ComputePointLight(gPointLights[lightIndex], mat,
+            pin.PosW, pin.NormalW, toEyeW);
+    }
+#endif
+
     float4 litColor = ambient + directLight;
 
 #ifdef FOG
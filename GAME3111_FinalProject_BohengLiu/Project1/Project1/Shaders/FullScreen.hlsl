@@ -0,0 +1,41 @@
+//***************************************************************************************
+// FullScreen.hlsl
+//
+// Fullscreen triangle pass that stretches the rendered region of the internal
+// color target onto the swap chain back buffer.  The scene renders into the
+// top-left corner of the full-size internal target at the current dynamic
+// resolution scale; gUvScale is that rendered fraction, so sampling the
+// scaled UV range upscales it to cover the whole back buffer.
+//***************************************************************************************
+
+Texture2D gInput : register(t0);
+
+SamplerState gsamLinearClamp : register(s3);
+
+cbuffer cbUpscale : register(b0)
+{
+    float2 gUvScale;   // rendered fraction of the internal target
+    float2 gUpscalePad;
+};
+
+struct VertexOut
+{
+    float4 PosH : SV_POSITION;
+    float2 TexC : TEXCOORD;
+};
+
+VertexOut VS(uint vid : SV_VertexID)
+{
+    VertexOut vout;
+
+    // One oversized triangle covering the screen; no vertex buffer needed.
+    vout.TexC = float2((vid << 1) & 2, vid & 2);
+    vout.PosH = float4(vout.TexC * float2(2.0f, -2.0f) + float2(-1.0f, 1.0f), 0.0f, 1.0f);
+
+    return vout;
+}
+
+float4 PS(VertexOut pin) : SV_Target
+{
+    return gInput.Sample(gsamLinearClamp, pin.TexC * gUvScale);
+}
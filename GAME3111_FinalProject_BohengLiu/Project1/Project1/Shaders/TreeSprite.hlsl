@@ -18,7 +18,10 @@
 // Include structures and functions for lighting.
 #include "LightingUtil.hlsl"
 //step5
-Texture2DArray gTreeMapArray : register(t0);
+// The SRV heap is bound once at its start; the tree array lives in slot 5,
+// after the scene diffuse maps and the packed castle map array Default.hlsl
+// indexes bindlessly.
+Texture2DArray gTreeMapArray : register(t5);
 
 //you can use dynamic indexing as well. Pay attention how we changed the sampler!
 //Texture2D gTreeMapArray[3] : register(t0);
@@ -77,108 +80,83 @@ cbuffer cbMaterial : register(b2)
 	float4x4 gMatTransform;
 };
  
-struct VertexIn
+// Per-tree instance data; the static scatter is uploaded once at init and
+// bound through the same structured buffer root SRV the instanced opaque
+// path uses (t0, space1).
+struct TreeInstanceData
 {
-	float3 PosW  : POSITION;
-	float2 SizeW : SIZE;
+	float3 PosW;
+	float2 SizeW;
 };
 
-struct VertexOut
+StructuredBuffer<TreeInstanceData> gTreeInstances : register(t0, space1);
+
+struct VertexIn
 {
-	float3 CenterW : POSITION;
-	float2 SizeW   : SIZE;
+	float2 Corner : POSITION;
+	float2 TexC   : TEXCOORD;
 };
 
-struct GeoOut
+struct VertexOut
 {
 	float4 PosH    : SV_POSITION;
     float3 PosW    : POSITION;
     float3 NormalW : NORMAL;
     float2 TexC    : TEXCOORD;
-    uint   PrimID  : SV_PrimitiveID;
+    nointerpolation uint TreeIndex : TREEINDEX;
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
 	VertexOut vout;
 
-	// Just pass data over to geometry shader.
-	vout.CenterW = vin.PosW;
-	vout.SizeW   = vin.SizeW;
+	TreeInstanceData inst = gTreeInstances[instanceID];
 
-	return vout;
-}
- 
-//step4
- // We expand each point into a quad (4 vertices), so the maximum number of vertices
- // we output per geometry shader invocation is 4.
-[maxvertexcount(4)]
-void GS(point VertexOut gin[1], //PrimitiveType InputVertexType InputName[NumElements]-> one vertex for a point, two for aline, threefor atriangle, four for line with adjacency, and six for a triangle with adjacency.
-        uint primID : SV_PrimitiveID, //inout StreamOutputObject<OutputVertexType>
-        inout TriangleStream<GeoOut> triStream)  //OutputName
-{	
 	//
 	// Compute the local coordinate system of the sprite relative to the world
-	// space such that the billboard is aligned with the y-axis and faces the eye.
+	// space such that the billboard is aligned with the y-axis and faces the
+	// eye.  Same basis the geometry shader used to build, now evaluated per
+	// corner of one shared quad so the GS expansion path is gone entirely.
 	//
 
 	float3 up = float3(0.0f, 1.0f, 0.0f);
-	float3 look = gEyePosW - gin[0].CenterW;
+	float3 look = gEyePosW - inst.PosW;
 	look.y = 0.0f; // y-axis aligned, so project to xz-plane
 	look = normalize(look);
 	float3 right = cross(up, look);
 
-	//
-	// Compute triangle strip vertices (quad) in world space.
-	//
-	float halfWidth  = 0.5f*gin[0].SizeW.x;
-	float halfHeight = 0.5f*gin[0].SizeW.y;
-	
-	float4 v[4];
-	v[0] = float4(gin[0].CenterW + halfWidth*right - halfHeight*up, 1.0f);
-	v[1] = float4(gin[0].CenterW + halfWidth*right + halfHeight*up, 1.0f);
-	v[2] = float4(gin[0].CenterW - halfWidth*right - halfHeight*up, 1.0f);
-	v[3] = float4(gin[0].CenterW - halfWidth*right + halfHeight*up, 1.0f);
+	// Corner offsets come in as [-0.5, 0.5] and scale by the sprite size.
+	float3 posW = inst.PosW + vin.Corner.x*inst.SizeW.x*right + vin.Corner.y*inst.SizeW.y*up;
 
-	//
-	// Transform quad vertices to world space and output 
-	// them as a triangle strip.
-	//
-	
-	float2 texC[4] = 
-	{
-		float2(0.0f, 1.0f),
-		float2(0.0f, 0.0f),
-		float2(1.0f, 1.0f),
-		float2(1.0f, 0.0f)
-	};
-	
-	GeoOut gout;
-	[unroll]
-	for(int i = 0; i < 4; ++i)
-	{
-		gout.PosH     = mul(v[i], gViewProj);
-		gout.PosW     = v[i].xyz;
-		gout.NormalW  = look;
-		gout.TexC     = texC[i];
-		gout.PrimID   = primID;
-		
-		triStream.Append(gout);
-	}
+	vout.PosH      = mul(float4(posW, 1.0f), gViewProj);
+	vout.PosW      = posW;
+	vout.NormalW   = look;
+	vout.TexC      = vin.TexC;
+	vout.TreeIndex = instanceID%3;
+
+	return vout;
 }
 
-//step6
-float4 PS(GeoOut pin) : SV_Target
+float4 PS(VertexOut pin) : SV_Target
 {
-	float3 uvw = float3(pin.TexC, pin.PrimID%3);
+	float3 uvw = float3(pin.TexC, pin.TreeIndex);
     float4 diffuseAlbedo = gTreeMapArray.Sample(gsamAnisotropicWrap, uvw) * gDiffuseAlbedo;
 
     //using dynamic indexing
-    //float4 diffuseAlbedo = gTreeMapArray[pin.PrimID % 3].Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
+    //float4 diffuseAlbedo = gTreeMapArray[pin.TreeIndex].Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
+
+    // Vector from point being lit to eye.  Needed ahead of the alpha test:
+	// sprite coverage dissolves over the last stretch of view distance, so
+	// the forest thins out and vanishes just before the CPU culls its whole
+	// cell at gVegetationFadeEnd (CastleApp.cpp) — keep the windows in sync.
+	float3 toEyeW = gEyePosW - pin.PosW;
+	float distToEye = length(toEyeW);
+	toEyeW /= distToEye; // normalize
+
+	diffuseAlbedo.a *= 1.0f - saturate((distToEye - 110.0f) / 30.0f);
 
-	
 #ifdef ALPHA_TEST
-	// Discard pixel if texture alpha < 0.1.  We do this test as soon 
+	// Discard pixel if texture alpha < 0.1.  We do this test as soon
 	// as possible in the shader so that we can potentially exit the
 	// shader early, thereby skipping the rest of the shader code.
 	clip(diffuseAlbedo.a - 0.1f);
@@ -187,11 +165,6 @@ float4 PS(GeoOut pin) : SV_Target
     // Interpolating normal can unnormalize it, so renormalize it.
     pin.NormalW = normalize(pin.NormalW);
 
-    // Vector from point being lit to eye. 
-	float3 toEyeW = gEyePosW - pin.PosW;
-	float distToEye = length(toEyeW);
-	toEyeW /= distToEye; // normalize
-
     // Light terms.
     float4 ambient = gAmbientLight*diffuseAlbedo;
 
@@ -0,0 +1,115 @@
+//=============================================================================
+// WaveSim.hlsl
+//
+// Compute-shader wave simulation.  UpdateWavesCS runs the finite-difference
+// solver over ping-ponged height planes, BuildWaveVertsCS rebuilds the full
+// vertex stream (position, normal, texcoord) from the current heights, and
+// DisturbWavesCS injects a ripple.  All data stays resident on the GPU; the
+// CPU only records the dispatches.
+//=============================================================================
+
+cbuffer cbWaveSettings : register(b0)
+{
+    float gK1;
+    float gK2;
+    float gK3;
+
+    float gDisturbMag;
+    int2 gDisturbIndex;
+
+    float gSpatialStep;
+    int gNumCols;
+    int gNumRows;
+};
+
+// Must match struct Vertex in FrameResource.h.
+struct WaveVertex
+{
+    float3 PosL;
+    float3 NormalL;
+    float2 TexC;
+};
+
+RWStructuredBuffer<float> gPrevSol : register(u0);
+RWStructuredBuffer<float> gCurrSol : register(u1);
+RWStructuredBuffer<float> gNextSol : register(u2);
+RWStructuredBuffer<WaveVertex> gVerts : register(u3);
+
+[numthreads(16, 16, 1)]
+void UpdateWavesCS(int3 dtid : SV_DispatchThreadID)
+{
+    int j = dtid.x; // column
+    int i = dtid.y; // row
+
+    if (i >= gNumRows || j >= gNumCols)
+        return;
+
+    // Zero boundary conditions: boundary points just copy through.
+    if (i == 0 || i == gNumRows - 1 || j == 0 || j == gNumCols - 1)
+    {
+        gNextSol[i * gNumCols + j] = 0.0f;
+        return;
+    }
+
+    gNextSol[i * gNumCols + j] =
+        gK1 * gPrevSol[i * gNumCols + j] +
+        gK2 * gCurrSol[i * gNumCols + j] +
+        gK3 * (gCurrSol[(i + 1) * gNumCols + j] +
+               gCurrSol[(i - 1) * gNumCols + j] +
+               gCurrSol[i * gNumCols + j + 1] +
+               gCurrSol[i * gNumCols + j - 1]);
+}
+
+[numthreads(16, 16, 1)]
+void BuildWaveVertsCS(int3 dtid : SV_DispatchThreadID)
+{
+    int j = dtid.x; // column
+    int i = dtid.y; // row
+
+    if (i >= gNumRows || j >= gNumCols)
+        return;
+
+    float halfWidth = (gNumCols - 1) * gSpatialStep * 0.5f;
+    float halfDepth = (gNumRows - 1) * gSpatialStep * 0.5f;
+
+    float x = -halfWidth + j * gSpatialStep;
+    float z = halfDepth - i * gSpatialStep;
+    float y = gCurrSol[i * gNumCols + j];
+
+    // Finite differences for the normal; clamp reads at the boundary.
+    int l = max(j - 1, 0);
+    int r = min(j + 1, gNumCols - 1);
+    int t = max(i - 1, 0);
+    int b = min(i + 1, gNumRows - 1);
+
+    float hl = gCurrSol[i * gNumCols + l];
+    float hr = gCurrSol[i * gNumCols + r];
+    float ht = gCurrSol[t * gNumCols + j];
+    float hb = gCurrSol[b * gNumCols + j];
+
+    WaveVertex v;
+    v.PosL = float3(x, y, z);
+    v.NormalL = normalize(float3(hl - hr, 2.0f * gSpatialStep, hb - ht));
+
+    // Derive tex-coords from position by mapping [-w/2,w/2] --> [0,1].
+    v.TexC.x = 0.5f + x / (gNumCols * gSpatialStep);
+    v.TexC.y = 0.5f - z / (gNumRows * gSpatialStep);
+
+    gVerts[i * gNumCols + j] = v;
+}
+
+[numthreads(1, 1, 1)]
+void DisturbWavesCS(int3 dtid : SV_DispatchThreadID)
+{
+    int j = gDisturbIndex.x; // column
+    int i = gDisturbIndex.y; // row
+
+    float halfMag = 0.5f * gDisturbMag;
+
+    // Disturb the ijth vertex height and its neighbors.
+    gCurrSol[i * gNumCols + j] += gDisturbMag;
+    gCurrSol[i * gNumCols + j + 1] += halfMag;
+    gCurrSol[i * gNumCols + j - 1] += halfMag;
+    gCurrSol[(i + 1) * gNumCols + j] += halfMag;
+    gCurrSol[(i - 1) * gNumCols + j] += halfMag;
+}
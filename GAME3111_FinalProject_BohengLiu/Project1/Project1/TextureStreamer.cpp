@@ -0,0 +1,123 @@
+#include "TextureStreamer.h"
+#include "../../Common/DDSTextureLoader.h"
+
+using Microsoft::WRL::ComPtr;
+
+TextureStreamer::TextureStreamer(ID3D12Device* device)
+    : md3dDevice(device)
+{
+    // The DDS loader records the COPY_DEST -> PIXEL_SHADER_RESOURCE barrier
+    // on the list it is handed, which a pure copy queue rejects, so the
+    // streamer owns a direct queue instead.  The point stands either way:
+    // file reads and UpdateSubresources happen off the main thread and
+    // Initialize never waits on them.
+    D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+    queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+    queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    ThrowIfFailed(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mQueue)));
+
+    ThrowIfFailed(device->CreateCommandAllocator(
+        D3D12_COMMAND_LIST_TYPE_DIRECT,
+        IID_PPV_ARGS(mCmdAlloc.GetAddressOf())));
+
+    ThrowIfFailed(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+        mCmdAlloc.Get(), nullptr, IID_PPV_ARGS(mCmdList.GetAddressOf())));
+    ThrowIfFailed(mCmdList->Close());
+
+    ThrowIfFailed(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence)));
+
+    mThread = std::thread(&TextureStreamer::LoaderThread, this);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQuit = true;
+    }
+    mPendingCv.notify_one();
+
+    if (mThread.joinable())
+        mThread.join();
+}
+
+void TextureStreamer::RequestTexture(Texture* tex)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPending.push(tex);
+    }
+    mPendingCv.notify_one();
+}
+
+std::vector<Texture*> TextureStreamer::CollectLoaded()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    std::vector<Texture*> loaded;
+    loaded.swap(mLoaded);
+    return loaded;
+}
+
+void TextureStreamer::LoaderThread()
+{
+    for (;;)
+    {
+        Texture* tex = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mPendingCv.wait(lock, [this] { return mQuit || !mPending.empty(); });
+
+            if (mPending.empty())
+                return;
+
+            tex = mPending.front();
+            mPending.pop();
+        }
+
+        // Record the upload; the loader memory-maps the DDS file and feeds
+        // UpdateSubresources from the view, so the file contents are never
+        // copied into a heap buffer first.  One texture in flight at a time
+        // keeps the single allocator safe to reuse.
+        ThrowIfFailed(mCmdAlloc->Reset());
+        ThrowIfFailed(mCmdList->Reset(mCmdAlloc.Get(), nullptr));
+
+        if (!tex->SliceFilenames.empty())
+        {
+            // Packed Texture2DArray: all slices load and upload as one job,
+            // so the whole array flips from placeholder to resident at once.
+            ThrowIfFailed(DirectX::CreateDDSTextureArrayFromFiles12(md3dDevice,
+                mCmdList.Get(), tex->SliceFilenames.data(), tex->SliceFilenames.size(),
+                tex->Resource, tex->UploadHeap));
+        }
+        else
+        {
+            ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice,
+                mCmdList.Get(), tex->Filename.c_str(),
+                tex->Resource, tex->UploadHeap));
+        }
+
+        ThrowIfFailed(mCmdList->Close());
+        ID3D12CommandList* cmdsLists[] = { mCmdList.Get() };
+        mQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+        ++mFenceValue;
+        ThrowIfFailed(mQueue->Signal(mFence.Get(), mFenceValue));
+
+        if (mFence->GetCompletedValue() < mFenceValue)
+        {
+            HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
+            ThrowIfFailed(mFence->SetEventOnCompletion(mFenceValue, eventHandle));
+            WaitForSingleObject(eventHandle, INFINITE);
+            CloseHandle(eventHandle);
+        }
+
+        // The GPU copy is done; the intermediate upload heap can go now.
+        tex->UploadHeap.Reset();
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mLoaded.push_back(tex);
+        }
+    }
+}
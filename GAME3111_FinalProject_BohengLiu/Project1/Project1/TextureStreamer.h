@@ -0,0 +1,56 @@
+//***************************************************************************************
+// TextureStreamer.h
+//
+// Loads DDS textures asynchronously on a dedicated queue.  CastleApp requests
+// every texture up front, binds a placeholder in each SRV slot, and patches
+// the descriptors as CollectLoaded reports files that finished uploading.
+// Initialize no longer serializes on disk reads and texture uploads.
+//***************************************************************************************
+
+#pragma once
+
+#include "../../Common/d3dUtil.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+class TextureStreamer
+{
+public:
+    TextureStreamer(ID3D12Device* device);
+    TextureStreamer(const TextureStreamer& rhs) = delete;
+    TextureStreamer& operator=(const TextureStreamer& rhs) = delete;
+    ~TextureStreamer();
+
+    // Queues tex->Filename for loading on the streamer thread.  tex->Resource
+    // must not be touched by the caller until tex comes back from
+    // CollectLoaded.
+    void RequestTexture(Texture* tex);
+
+    // Returns the textures whose uploads have completed on the GPU since the
+    // last call.  Safe to call every frame from the main thread.
+    std::vector<Texture*> CollectLoaded();
+
+private:
+    void LoaderThread();
+
+    ID3D12Device* md3dDevice = nullptr;
+
+    Microsoft::WRL::ComPtr<ID3D12CommandQueue> mQueue;
+    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mCmdAlloc;
+    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCmdList;
+
+    Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+    UINT64 mFenceValue = 0;
+
+    std::thread mThread;
+    std::mutex mMutex;
+    std::condition_variable mPendingCv;
+
+    // Guarded by mMutex.
+    std::queue<Texture*> mPending;
+    std::vector<Texture*> mLoaded;
+    bool mQuit = false;
+};
@@ -4,7 +4,10 @@
 
 #include "Waves.h"
 #include <ppl.h>
+#include <immintrin.h>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <vector>
 #include <cassert>
 
@@ -27,10 +30,15 @@ Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
     mK2 = (4.0f - 8.0f*e) / d;
     mK3 = (2.0f*e) / d;
 
-    mPrevSolution.resize(m*n);
-    mCurrSolution.resize(m*n);
-    mNormals.resize(m*n);
-    mTangentX.resize(m*n);
+    mGridX.resize(m*n);
+    mGridZ.resize(m*n);
+    mPrevHeight.resize(m*n, 0.0f);
+    mCurrHeight.resize(m*n, 0.0f);
+    mNormalX.resize(m*n, 0.0f);
+    mNormalY.resize(m*n, 1.0f);
+    mNormalZ.resize(m*n, 0.0f);
+    mTangentXX.resize(m*n, 1.0f);
+    mTangentXY.resize(m*n, 0.0f);
 
     // Generate grid vertices in system memory.
 
@@ -43,12 +51,18 @@ Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
         {
             float x = -halfWidth + j*dx;
 
-            mPrevSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mCurrSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mNormals[i*n + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
-            mTangentX[i*n + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
+            mGridX[i*n + j] = x;
+            mGridZ[i*n + j] = z;
         }
     }
+
+    // Activity tiling starts fully quiescent; the first disturb wakes the
+    // tiles it touches.
+    mTileRows = (m + TileSize - 1) / TileSize;
+    mTileCols = (n + TileSize - 1) / TileSize;
+    mTileActive.resize(mTileRows*mTileCols, 0);
+    mTileNextActive.resize(mTileRows*mTileCols, 0);
+    mTileEnergy.resize(mTileRows*mTileCols, 0.0f);
 }
 
 Waves::~Waves()
@@ -89,68 +103,273 @@ void Waves::Update(float dt)
 {
 	static float t = 0;
 
+	// Drain the disturb queue before stepping so a frame's worth of ripples
+	// lands in one pass over the height plane instead of scattered writes.
+	ApplyQueuedDisturbs();
+
 	// Accumulate time.
 	t += dt;
 
 	// Only update the simulation at the specified time step.
 	if( t >= mTimeStep )
 	{
-		// Only update interior points; we use zero boundary conditions.
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows-1; ++i)
+		t = 0.0f; // reset time
+
+		// Fully quiesced: nothing has disturbed the water and every tile
+		// has settled, so the step costs nothing at all.
+		if(mActiveTiles.empty())
+			return;
+
+		// Step only the live tiles.  Each task owns its tile's cells, so
+		// the energy slots write without contention; stencil reads that
+		// cross into a frozen neighbor see its identical, unmoving planes.
+		concurrency::parallel_for(0, (int)mActiveTiles.size(), [this](int n)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
-			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
-			}
+			int tile = mActiveTiles[n];
+			int i0, i1, j0, j1;
+			TileRange(tile, i0, i1, j0, j1);
+
+			float energy = 0.0f;
+			for(int i = i0; i < i1; ++i)
+				energy = std::max(energy, StepRowSegment(i, j0, j1));
+
+			mTileEnergy[tile] = energy;
 		});
 
 		// We just overwrote the previous buffer with the new data, so
 		// this data needs to become the current solution and the old
 		// current solution becomes the new previous solution.
-		std::swap(mPrevSolution, mCurrSolution);
-
-		t = 0.0f; // reset time
+		std::swap(mPrevHeight, mCurrHeight);
 
 		//
-		// Compute normals using finite difference scheme.
+		// Compute normals and tangents using finite difference scheme,
+		// again only where the water is moving.
 		//
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows - 1; ++i)
+		concurrency::parallel_for(0, (int)mActiveTiles.size(), [this](int n)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
+			int i0, i1, j0, j1;
+			TileRange(mActiveTiles[n], i0, i1, j0, j1);
+
+			for(int i = i0; i < i1; ++i)
+				UpdateNormalsSegment(i, j0, j1);
+		});
+
+		// Rebuild the active set: an energetic tile stays live and keeps
+		// its eight neighbors awake so the front always lands in stepping
+		// tiles; a settled tile freezes with both height planes made
+		// identical, which is what makes the future swaps no-ops for it.
+		std::fill(mTileNextActive.begin(), mTileNextActive.end(), 0);
+		for(int tile : mActiveTiles)
+		{
+			if(mTileEnergy[tile] <= SettleThreshold)
+				continue;
+
+			int ti = tile / mTileCols;
+			int tj = tile % mTileCols;
+			for(int di = -1; di <= 1; ++di)
 			{
-				float l = mCurrSolution[i*mNumCols+j-1].y;
-				float r = mCurrSolution[i*mNumCols+j+1].y;
-				float t = mCurrSolution[(i-1)*mNumCols+j].y;
-				float b = mCurrSolution[(i+1)*mNumCols+j].y;
-				mNormals[i*mNumCols+j].x = -r+l;
-				mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
-				mNormals[i*mNumCols+j].z = b-t;
-
-				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
-				XMStoreFloat3(&mNormals[i*mNumCols+j], n);
-
-				mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
-				XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
-				XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
+				for(int dj = -1; dj <= 1; ++dj)
+				{
+					int ni = ti + di;
+					int nj = tj + dj;
+					if(ni >= 0 && ni < mTileRows && nj >= 0 && nj < mTileCols)
+						mTileNextActive[ni*mTileCols + nj] = 1;
+				}
 			}
-		});
+		}
+
+		for(int tile : mActiveTiles)
+		{
+			if(!mTileNextActive[tile])
+				FreezeTile(tile);
+		}
+
+		mTileActive.swap(mTileNextActive);
+		mActiveTiles.clear();
+		for(int tile = 0; tile < (int)mTileActive.size(); ++tile)
+		{
+			if(mTileActive[tile])
+				mActiveTiles.push_back(tile);
+		}
+	}
+}
+
+float Waves::StepRowSegment(int i, int j0, int j1)
+{
+	const float* prev = mPrevHeight.data();
+	const float* curr = mCurrHeight.data();
+	float* next = mPrevHeight.data();
+
+	const __m256 k1 = _mm256_set1_ps(mK1);
+	const __m256 k2 = _mm256_set1_ps(mK2);
+	const __m256 k3 = _mm256_set1_ps(mK3);
+	const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+	__m256 energyV = _mm256_setzero_ps();
+	float energy = 0.0f;
+
+	// After this update we will be discarding the old previous
+	// buffer, so overwrite that buffer with the new update.
+	// We can do this inplace (read/write to same element) because
+	// prev_ij is not needed again and the store happens last.
+	//
+	// Note j indexes x and i indexes z: h(x_j, z_i, t_k).
+
+	int row = i*mNumCols;
+	int j = j0;
+
+	// 8 columns per iteration; unaligned loads since the segment
+	// rarely starts on a lane boundary.
+	for(; j + 8 <= j1; j += 8)
+	{
+		__m256 p  = _mm256_loadu_ps(prev + row + j);
+		__m256 c  = _mm256_loadu_ps(curr + row + j);
+		__m256 cu = _mm256_loadu_ps(curr + row + mNumCols + j);
+		__m256 cd = _mm256_loadu_ps(curr + row - mNumCols + j);
+		__m256 cr = _mm256_loadu_ps(curr + row + j + 1);
+		__m256 cl = _mm256_loadu_ps(curr + row + j - 1);
+
+		__m256 sum = _mm256_add_ps(_mm256_add_ps(cu, cd), _mm256_add_ps(cr, cl));
+		__m256 h = _mm256_add_ps(
+			_mm256_add_ps(_mm256_mul_ps(k1, p), _mm256_mul_ps(k2, c)),
+			_mm256_mul_ps(k3, sum));
+
+		_mm256_storeu_ps(next + row + j, h);
+
+		// Residual energy: the larger of the new height and the step
+		// delta, so standing offsets and motion both keep a tile live.
+		__m256 d = _mm256_sub_ps(h, c);
+		energyV = _mm256_max_ps(energyV,
+			_mm256_max_ps(_mm256_andnot_ps(signMask, h), _mm256_andnot_ps(signMask, d)));
+	}
+
+	// Scalar remainder.
+	for(; j < j1; ++j)
+	{
+		float h =
+			mK1*prev[row + j] +
+			mK2*curr[row + j] +
+			mK3*(curr[row + mNumCols + j] +
+			     curr[row - mNumCols + j] +
+			     curr[row + j + 1] +
+			     curr[row + j - 1]);
+
+		energy = std::max(energy, std::max(fabsf(h), fabsf(h - curr[row + j])));
+		next[row + j] = h;
+	}
+
+	// Fold the vector lanes into the scalar max.
+	float lanes[8];
+	_mm256_storeu_ps(lanes, energyV);
+	for(int k = 0; k < 8; ++k)
+		energy = std::max(energy, lanes[k]);
+
+	return energy;
+}
+
+void Waves::UpdateNormalsSegment(int i, int j0, int j1)
+{
+	const float* curr = mCurrHeight.data();
+
+	const __m256 twoDx = _mm256_set1_ps(2.0f*mSpatialStep);
+
+	int row = i*mNumCols;
+	int j = j0;
+
+	for(; j + 8 <= j1; j += 8)
+	{
+		__m256 l = _mm256_loadu_ps(curr + row + j - 1);
+		__m256 r = _mm256_loadu_ps(curr + row + j + 1);
+		__m256 tt = _mm256_loadu_ps(curr + row - mNumCols + j);
+		__m256 b = _mm256_loadu_ps(curr + row + mNumCols + j);
+
+		// Unnormalized normal (l-r, 2*dx, b-t).
+		__m256 nx = _mm256_sub_ps(l, r);
+		__m256 ny = twoDx;
+		__m256 nz = _mm256_sub_ps(b, tt);
+
+		// rsqrt-based normalization, 8 vertices at once.
+		__m256 lenSq = _mm256_add_ps(
+			_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)),
+			_mm256_mul_ps(nz, nz));
+		__m256 invLen = _mm256_rsqrt_ps(lenSq);
+
+		_mm256_storeu_ps(mNormalX.data() + row + j, _mm256_mul_ps(nx, invLen));
+		_mm256_storeu_ps(mNormalY.data() + row + j, _mm256_mul_ps(ny, invLen));
+		_mm256_storeu_ps(mNormalZ.data() + row + j, _mm256_mul_ps(nz, invLen));
+
+		// Unnormalized tangent (2*dx, r-l, 0).
+		__m256 tx = twoDx;
+		__m256 ty = _mm256_sub_ps(r, l);
+
+		__m256 tLenSq = _mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty));
+		__m256 tInvLen = _mm256_rsqrt_ps(tLenSq);
+
+		_mm256_storeu_ps(mTangentXX.data() + row + j, _mm256_mul_ps(tx, tInvLen));
+		_mm256_storeu_ps(mTangentXY.data() + row + j, _mm256_mul_ps(ty, tInvLen));
+	}
+
+	// Scalar remainder.
+	for(; j < j1; ++j)
+	{
+		float l = curr[row + j - 1];
+		float r = curr[row + j + 1];
+		float tt = curr[row - mNumCols + j];
+		float b = curr[row + mNumCols + j];
+
+		float nx = l - r;
+		float ny = 2.0f*mSpatialStep;
+		float nz = b - tt;
+
+		float invLen = 1.0f / sqrtf(nx*nx + ny*ny + nz*nz);
+		mNormalX[row + j] = nx*invLen;
+		mNormalY[row + j] = ny*invLen;
+		mNormalZ[row + j] = nz*invLen;
+
+		float tx = 2.0f*mSpatialStep;
+		float ty = r - l;
+
+		float tInvLen = 1.0f / sqrtf(tx*tx + ty*ty);
+		mTangentXX[row + j] = tx*tInvLen;
+		mTangentXY[row + j] = ty*tInvLen;
+	}
+}
+
+void Waves::TileRange(int tile, int& i0, int& i1, int& j0, int& j1) const
+{
+	int ti = tile / mTileCols;
+	int tj = tile % mTileCols;
+
+	// Clamp to the interior; the boundary rows and columns stay zero.
+	i0 = std::max(1, ti*TileSize);
+	i1 = std::min(mNumRows - 1, (ti + 1)*TileSize);
+	j0 = std::max(1, tj*TileSize);
+	j1 = std::min(mNumCols - 1, (tj + 1)*TileSize);
+}
+
+void Waves::ActivateTile(int ti, int tj)
+{
+	if(ti < 0 || ti >= mTileRows || tj < 0 || tj >= mTileCols)
+		return;
+
+	int tile = ti*mTileCols + tj;
+	if(mTileActive[tile])
+		return;
+
+	mTileActive[tile] = 1;
+	mActiveTiles.push_back(tile);
+}
+
+void Waves::FreezeTile(int tile)
+{
+	int i0, i1, j0, j1;
+	TileRange(tile, i0, i1, j0, j1);
+
+	for(int i = i0; i < i1; ++i)
+	{
+		memcpy(mPrevHeight.data() + i*mNumCols + j0,
+		       mCurrHeight.data() + i*mNumCols + j0,
+		       (size_t)(j1 - j0)*sizeof(float));
 	}
 }
 
@@ -160,13 +379,55 @@ void Waves::Disturb(int i, int j, float magnitude)
 	assert(i > 1 && i < mNumRows-2);
 	assert(j > 1 && j < mNumCols-2);
 
+	// Claim a slot, then publish the payload with a release store so the
+	// simulation thread never reads a half-written event.
+	int slot = mDisturbCount.fetch_add(1, std::memory_order_relaxed);
+	if(slot >= MaxDisturbEvents)
+		return; // queue full this frame; drop the ripple
+
+	mDisturbEvents[slot].I = i;
+	mDisturbEvents[slot].J = j;
+	mDisturbEvents[slot].Magnitude = magnitude;
+	mDisturbReady[slot].store(true, std::memory_order_release);
+}
+
+void Waves::ApplyQueuedDisturbs()
+{
+	int count = mDisturbCount.load(std::memory_order_acquire);
+	if(count == 0)
+		return;
+
+	count = std::min(count, MaxDisturbEvents);
+	for(int k = 0; k < count; ++k)
+	{
+		// A producer that claimed this slot may still be writing the
+		// payload; its store is imminent, so spin rather than lose it.
+		while(!mDisturbReady[k].load(std::memory_order_acquire))
+			_mm_pause();
+
+		ApplyDisturb(mDisturbEvents[k].I, mDisturbEvents[k].J, mDisturbEvents[k].Magnitude);
+		mDisturbReady[k].store(false, std::memory_order_relaxed);
+	}
+
+	mDisturbCount.store(0, std::memory_order_release);
+}
+
+void Waves::ApplyDisturb(int i, int j, float magnitude)
+{
+	// Wake the tile the splash lands in along with its neighbors: the half
+	// magnitudes touch adjacent cells, and the front spreads immediately.
+	int ti = i / TileSize;
+	int tj = j / TileSize;
+	for(int di = -1; di <= 1; ++di)
+		for(int dj = -1; dj <= 1; ++dj)
+			ActivateTile(ti + di, tj + dj);
+
 	float halfMag = 0.5f*magnitude;
 
 	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i*mNumCols+j].y     += magnitude;
-	mCurrSolution[i*mNumCols+j+1].y   += halfMag;
-	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
-	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
-	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+	mCurrHeight[i*mNumCols+j]     += magnitude;
+	mCurrHeight[i*mNumCols+j+1]   += halfMag;
+	mCurrHeight[i*mNumCols+j-1]   += halfMag;
+	mCurrHeight[(i+1)*mNumCols+j] += halfMag;
+	mCurrHeight[(i-1)*mNumCols+j] += halfMag;
 }
-	
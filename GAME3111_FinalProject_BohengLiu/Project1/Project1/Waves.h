@@ -4,11 +4,26 @@
 // Performs the calculations for the wave simulation.  After the simulation has been
 // updated, the client must copy the current solution into vertex buffers for rendering.
 // This class only does the calculations, it does not do any drawing.
+//
+// Storage is structure-of-arrays: heights, normals, and tangents live in
+// separate contiguous float planes so the finite-difference stencil and the
+// normal pass read/write dense memory and vectorize (AVX, 8 lanes per
+// iteration).  The accessors keep the old per-vertex interface, now returning
+// by value since the packed planes no longer hold whole XMFLOAT3s.
+//
+// The grid is further partitioned into square tiles with per-tile activity
+// tracking: a disturb wakes its tile and neighbors, each step measures a
+// tile's residual energy, and energetic tiles keep their neighbors awake so
+// the wavefront always lands in live tiles.  Settled tiles freeze (both
+// height planes made identical, so the buffer swap leaves them untouched)
+// and cost nothing, letting the whole simulation quiesce to zero work once
+// the water goes glassy.
 //***************************************************************************************
 
 #ifndef WAVES_H
 #define WAVES_H
 
+#include <atomic>
 #include <vector>
 #include <DirectXMath.h>
 
@@ -28,17 +43,55 @@ public:
 	float Depth()const;
 
 	// Returns the solution at the ith grid point.
-    const DirectX::XMFLOAT3& Position(int i)const { return mCurrSolution[i]; }
+    DirectX::XMFLOAT3 Position(int i)const
+    {
+        return DirectX::XMFLOAT3(mGridX[i], mCurrHeight[i], mGridZ[i]);
+    }
 
 	// Returns the solution normal at the ith grid point.
-    const DirectX::XMFLOAT3& Normal(int i)const { return mNormals[i]; }
+    DirectX::XMFLOAT3 Normal(int i)const
+    {
+        return DirectX::XMFLOAT3(mNormalX[i], mNormalY[i], mNormalZ[i]);
+    }
 
 	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
-    const DirectX::XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
+    DirectX::XMFLOAT3 TangentX(int i)const
+    {
+        return DirectX::XMFLOAT3(mTangentXX[i], mTangentXY[i], 0.0f);
+    }
 
 	void Update(float dt);
+
+	// Enqueues a ripple; safe to call from any thread.  The simulation runs
+	// on its own thread, so callers never touch the height planes directly:
+	// events accumulate in a lock-free MPSC queue and Update applies them in
+	// one batched pass before stepping the solver.  Events past the queue
+	// capacity in a single frame are dropped.
 	void Disturb(int i, int j, float magnitude);
 
+private:
+	void ApplyDisturb(int i, int j, float magnitude);
+	void ApplyQueuedDisturbs();
+
+	// Clamped interior cell range a tile covers, as [i0,i1) x [j0,j1).
+	void TileRange(int tile, int& i0, int& i1, int& j0, int& j1) const;
+
+	// Adds the tile to the active set if it is not there already.  Sim
+	// thread only.
+	void ActivateTile(int ti, int tj);
+
+	// Copies a settled tile's current heights over its previous heights so
+	// the per-step plane swap becomes a no-op for it.
+	void FreezeTile(int tile);
+
+	// Steps the solver over one row segment, writing the new heights into
+	// the previous-height plane in place; returns the segment's residual
+	// energy (max of |height| and |height delta|).
+	float StepRowSegment(int i, int j0, int j1);
+
+	// Recomputes normals and tangents over one row segment.
+	void UpdateNormalsSegment(int i, int j0, int j1);
+
 private:
     int mNumRows = 0;
     int mNumCols = 0;
@@ -54,10 +107,49 @@ private:
     float mTimeStep = 0.0f;
     float mSpatialStep = 0.0f;
 
-    std::vector<DirectX::XMFLOAT3> mPrevSolution;
-    std::vector<DirectX::XMFLOAT3> mCurrSolution;
-    std::vector<DirectX::XMFLOAT3> mNormals;
-    std::vector<DirectX::XMFLOAT3> mTangentX;
+    // x/z grid positions never change; they are kept only for Position().
+    std::vector<float> mGridX;
+    std::vector<float> mGridZ;
+
+    // Height planes for the finite-difference solver.
+    std::vector<float> mPrevHeight;
+    std::vector<float> mCurrHeight;
+
+    // Normal and tangent planes.  Tangent z is always 0 so it is not stored.
+    std::vector<float> mNormalX;
+    std::vector<float> mNormalY;
+    std::vector<float> mNormalZ;
+    std::vector<float> mTangentXX;
+    std::vector<float> mTangentXY;
+
+    // Pending disturb events.  Producers claim a slot with a fetch_add on
+    // the count and publish the payload with a release store on the slot's
+    // ready flag; the simulation thread drains all claimed slots at the top
+    // of Update.
+    struct DisturbEvent
+    {
+        int I = 0;
+        int J = 0;
+        float Magnitude = 0.0f;
+    };
+
+    static const int MaxDisturbEvents = 256;
+    DisturbEvent mDisturbEvents[MaxDisturbEvents];
+    std::atomic<bool> mDisturbReady[MaxDisturbEvents] = {};
+    std::atomic<int> mDisturbCount{0};
+
+    // Activity tiling.  A tile whose residual energy stays below the settle
+    // threshold for a step freezes; disturbs and energetic neighbors wake
+    // tiles back up.  All of this state belongs to the simulation thread.
+    static const int TileSize = 32;
+    static constexpr float SettleThreshold = 0.001f;
+
+    int mTileRows = 0;
+    int mTileCols = 0;
+    std::vector<char> mTileActive;
+    std::vector<char> mTileNextActive;    // scratch for the per-step rebuild
+    std::vector<float> mTileEnergy;
+    std::vector<int> mActiveTiles;
 };
 
-#endif // WAVES_H
\ No newline at end of file
+#endif // WAVES_H